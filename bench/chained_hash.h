@@ -0,0 +1,41 @@
+#ifndef CHAINED_HASH_H
+#define CHAINED_HASH_H
+
+/*----- System Includes -----*/
+
+#include <pthread.h>
+
+/*----- Numerical Constants -----*/
+
+#define CHAINED_HASH_START_SIZE 10
+#define CHAINED_HASH_SUCCESS 0x0
+#define CHAINED_HASH_FROZEN -0x01
+#define CHAINED_HASH_NOMEM -0x02
+#define CHAINED_HASH_INVAL -0x04
+#define CHAINED_HASH_EXISTS -0x08
+#define CHAINED_HASH_NOTFOUND -0x10
+
+/*----- Struct Declarations -----*/
+
+typedef struct chained_hash_node chained_hash_node_t;
+
+// Struct represents a basic hashtable.
+typedef struct chained_hash {
+  chained_hash_node_t **data;
+  void (*destruct) (void *);
+  int count, size, dynamic, frozen;
+  pthread_rwlock_t lock;
+} chained_hash_t;
+
+/*----- Hash Functions -----*/
+
+chained_hash_t *chained_create_hash(void (*destruct) (void *));
+int chained_init_hash(chained_hash_t *table, void (*destruct) (void *));
+int chained_hash_put(chained_hash_t *table, char *key, void *data);
+void *chained_hash_get(chained_hash_t *table, char *key);
+int chained_hash_drop(chained_hash_t *table, char *key);
+char **chained_hash_keys(chained_hash_t *table);
+void chained_hash_freeze(chained_hash_t *table);
+void chained_destroy_hash(chained_hash_t *table);
+
+#endif
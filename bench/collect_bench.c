@@ -0,0 +1,189 @@
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+
+/*----- Local Includes -----*/
+
+#include "../monitor/worker.h"
+
+/*----- Numerical Constants -----*/
+
+#define BENCH_ITERATIONS 3
+#define BENCH_TOTAL_OPS 10000
+
+// Benchmark for the collectors in monitor/worker.c, run against a procfs tree from
+// bin/proc_fixture, or the real /proc. CPU collectors normally watch counters for a second;
+// here they don't wait at all, so what's measured is the cost of reading and parsing.
+// Allocations count every trip to malloc, including the ones stdio makes for us.
+// Usage: collect_bench [root] [iterations]
+
+/*----- Type Declarations -----*/
+
+typedef struct bench_counts {
+  long allocs, bytes;
+} bench_counts_t;
+
+/*----- Function Declarations -----*/
+
+double now();
+int find_pids(char *root, uint16_t **pids);
+void bench_process(char *name, int (*collect) (uint16_t, task_report_t *), uint16_t *pids, int num_pids, int iterations);
+void bench_total(char *name, int (*collect) (task_report_t *), int ops);
+void bench_directory(char *root, int iterations);
+void report_result(char *name, long ops, long errors, double elapsed, bench_counts_t *start);
+int process_cpu_now(uint16_t pid, task_report_t *data);
+int total_cpu_now(task_report_t *data);
+
+// glibc lets a program replace malloc, and then uses the replacement itself, so this is
+// enough to see what stdio is allocating behind our backs.
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+/*----- Evil but Necessary Globals -----*/
+
+bench_counts_t counts;
+
+/*----- Function Implementations -----*/
+
+int main(int argc, char **argv) {
+  char *root = argc > 1 ? argv[1] : NOTGIOS_PROC_ROOT;
+  int iterations = argc > 2 ? atoi(argv[2]) : BENCH_ITERATIONS;
+  uint16_t *pids;
+
+  proc_root = root;
+  logger_set_level(-1);
+
+  int num_pids = find_pids(root, &pids);
+  if (num_pids < 0 || iterations < 1) {
+    fprintf(stderr, "collect_bench: can't read processes out of %s\n", root);
+    return EXIT_FAILURE;
+  }
+  printf("collect_bench: %d processes under %s\n", num_pids, root);
+
+  printf("%-16s %10s %8s %12s %10s %10s %10s\n", "collector", "ops", "errors", "total ms", "ns/op", "allocs/op", "bytes/op");
+  bench_process("process_memory", process_memory_collect, pids, num_pids, iterations);
+  bench_process("process_cpu", process_cpu_now, pids, num_pids, iterations);
+  bench_total("total_memory", total_memory_collect, BENCH_TOTAL_OPS);
+  bench_total("total_cpu", total_cpu_now, BENCH_TOTAL_OPS);
+  bench_directory(root, iterations);
+  free(pids);
+  return EXIT_SUCCESS;
+}
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Function collects every numeric directory under root, which is every process.
+int find_pids(char *root, uint16_t **pids) {
+  int count = 0, size = 1024;
+  DIR *directory = opendir(root);
+  *pids = malloc(sizeof(uint16_t) * size);
+  if (!directory || !*pids) {
+    if (directory) closedir(directory);
+    free(*pids);
+    return -1;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(directory))) {
+    if (!isdigit(entry->d_name[0])) continue;
+    long pid = atol(entry->d_name);
+    if (pid > UINT16_MAX) continue;
+    if (count == size) {
+      uint16_t *bigger = realloc(*pids, sizeof(uint16_t) * (size *= 2));
+      if (!bigger) break;
+      *pids = bigger;
+    }
+    (*pids)[count++] = pid;
+  }
+  closedir(directory);
+  return count;
+}
+
+void bench_process(char *name, int (*collect) (uint16_t, task_report_t *), uint16_t *pids, int num_pids, int iterations) {
+  task_report_t report;
+  long errors = 0;
+  bench_counts_t start = counts;
+
+  double started = now();
+  for (int i = 0; i < iterations; i++) {
+    for (int j = 0; j < num_pids; j++) {
+      if (collect(pids[j], &report) != NOTGIOS_SUCCESS) errors++;
+    }
+  }
+  report_result(name, (long) iterations * num_pids, errors, now() - started, &start);
+}
+
+void bench_total(char *name, int (*collect) (task_report_t *), int ops) {
+  task_report_t report;
+  long errors = 0;
+  bench_counts_t start = counts;
+
+  double started = now();
+  for (int i = 0; i < ops; i++) {
+    if (collect(&report) != NOTGIOS_SUCCESS) errors++;
+  }
+  report_result(name, ops, errors, now() - started, &start);
+}
+
+void bench_directory(char *root, int iterations) {
+  long errors = 0;
+  bench_counts_t start = counts;
+
+  double started = now();
+  for (int i = 0; i < iterations; i++) {
+    if (directory_memory_collect(root) < 0) errors++;
+  }
+  report_result("directory", iterations, errors, now() - started, &start);
+}
+
+void report_result(char *name, long ops, long errors, double elapsed, bench_counts_t *start) {
+  printf("%-16s %10ld %8ld %12.2f %10.1f %10.2f %10.1f\n", name, ops, errors, elapsed, elapsed * 1000000.0 / ops,
+      (counts.allocs - start->allocs) / (double) ops, (counts.bytes - start->bytes) / (double) ops);
+}
+
+// CPU collectors are told not to wait at all between reading their counters.
+int process_cpu_now(uint16_t pid, task_report_t *data) {
+  return process_cpu_collect(pid, data, 0);
+}
+
+int total_cpu_now(task_report_t *data) {
+  return total_cpu_collect(data, 0);
+}
+
+// Collectors never enqueue anything themselves, but the handlers they're linked with do.
+void enqueue_report(task_report_t *report) {
+  (void) report;
+}
+
+void *malloc(size_t size) {
+  counts.allocs++;
+  counts.bytes += size;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+  counts.allocs++;
+  counts.bytes += num * size;
+  return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  counts.allocs++;
+  counts.bytes += size;
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  __libc_free(ptr);
+}
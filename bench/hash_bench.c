@@ -0,0 +1,166 @@
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*----- Local Includes -----*/
+
+#include "../include/hash.h"
+#include "chained_hash.h"
+
+/*----- Numerical Constants -----*/
+
+#define BENCH_KEY_LEN 16
+#define BENCH_CHAINED_LIMIT 100000
+
+// Microbenchmark for hash_put/hash_get/hash_drop against the chained table we used to have,
+// plus hash_foreach and hash_drain on their own, which double as a check that every entry is
+// visited, and offered up for draining, exactly once. Keys look like task ids: a short prefix
+// and a number. Usage: hash_bench [--all]
+// By default the chained table is skipped past BENCH_CHAINED_LIMIT keys, because its hash
+// function piles everything into a handful of buckets and a million keys takes forever.
+
+/*----- Function Declarations -----*/
+
+double now();
+char *make_keys(int count);
+void bench_open(char *keys, int count);
+void bench_chained(char *keys, int count);
+int bench_drain(char *keys, int count);
+int count_entry(char *key, void *data, void *arg);
+int odd_entry(char *key, void *data, void *arg);
+void report(char *table, char *op, int count, double elapsed);
+void nop(void *data);
+
+/*----- Function Implementations -----*/
+
+int main(int argc, char **argv) {
+  int all = argc > 1 && !strcmp(argv[1], "--all");
+  int sizes[] = {10000, 100000, 1000000};
+
+  printf("%-8s %-5s %8s %12s %10s\n", "table", "op", "keys", "total ms", "ns/op");
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+    char *keys = make_keys(sizes[i]);
+    if (!keys) {
+      fprintf(stderr, "hash_bench: out of memory\n");
+      return EXIT_FAILURE;
+    }
+    bench_open(keys, sizes[i]);
+    int failed = bench_drain(keys, sizes[i]);
+    if (all || sizes[i] <= BENCH_CHAINED_LIMIT) bench_chained(keys, sizes[i]);
+    free(keys);
+    if (failed) return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+char *make_keys(int count) {
+  char *keys = malloc(count * BENCH_KEY_LEN);
+  if (!keys) return NULL;
+  for (int i = 0; i < count; i++) snprintf(keys + i * BENCH_KEY_LEN, BENCH_KEY_LEN, "task-%d", i);
+  return keys;
+}
+
+void bench_open(char *keys, int count) {
+  hash_t table;
+  init_hash(&table, nop);
+
+  double start = now();
+  for (int i = 0; i < count; i++) hash_put(&table, keys + i * BENCH_KEY_LEN, keys);
+  report("open", "put", count, now() - start);
+
+  start = now();
+  for (int i = 0; i < count; i++) {
+    if (!hash_get(&table, keys + i * BENCH_KEY_LEN)) fprintf(stderr, "hash_bench: lost a key\n");
+  }
+  report("open", "get", count, now() - start);
+
+  start = now();
+  for (int i = 0; i < count; i++) hash_drop(&table, keys + i * BENCH_KEY_LEN);
+  report("open", "drop", count, now() - start);
+
+  destroy_hash(&table);
+}
+
+// Function walks a full table, then drains every odd key out of it, and checks that
+// everything that should be left is, and nothing else. Returns nonzero if it isn't.
+int bench_drain(char *keys, int count) {
+  hash_t table;
+  long seen = 0, offered = 0;
+  int failed = 0;
+  init_hash(&table, nop);
+  for (int i = 0; i < count; i++) hash_put(&table, keys + i * BENCH_KEY_LEN, keys);
+
+  double start = now();
+  hash_foreach(&table, count_entry, &seen);
+  report("open", "each", count, now() - start);
+
+  start = now();
+  int dropped = hash_drain(&table, odd_entry, &offered);
+  report("open", "drain", count, now() - start);
+
+  if (seen != count || offered != count || dropped != count / 2) failed = 1;
+  for (int i = 0; i < count; i++) {
+    int present = hash_get(&table, keys + i * BENCH_KEY_LEN) != NULL;
+    if (present != !(i % 2)) failed = 1;
+  }
+  seen = 0;
+  hash_foreach(&table, count_entry, &seen);
+  if (seen != count - count / 2) failed = 1;
+  if (failed) {
+    fprintf(stderr, "hash_bench: foreach saw %ld, drain offered %ld and dropped %d of %d keys\n", seen, offered, dropped, count);
+  }
+
+  destroy_hash(&table);
+  return failed;
+}
+
+int count_entry(char *key, void *data, void *arg) {
+  (void) key;
+  (void) data;
+  (*(long *) arg)++;
+  return 0;
+}
+
+int odd_entry(char *key, void *data, void *arg) {
+  (void) data;
+  (*(long *) arg)++;
+  return atoi(strchr(key, '-') + 1) % 2;
+}
+
+void bench_chained(char *keys, int count) {
+  chained_hash_t table;
+  chained_init_hash(&table, nop);
+
+  double start = now();
+  for (int i = 0; i < count; i++) chained_hash_put(&table, keys + i * BENCH_KEY_LEN, keys);
+  report("chained", "put", count, now() - start);
+
+  start = now();
+  for (int i = 0; i < count; i++) {
+    if (!chained_hash_get(&table, keys + i * BENCH_KEY_LEN)) fprintf(stderr, "hash_bench: lost a key\n");
+  }
+  report("chained", "get", count, now() - start);
+
+  start = now();
+  for (int i = 0; i < count; i++) chained_hash_drop(&table, keys + i * BENCH_KEY_LEN);
+  report("chained", "drop", count, now() - start);
+
+  chained_destroy_hash(&table);
+}
+
+void report(char *table, char *op, int count, double elapsed) {
+  printf("%-8s %-5s %8d %12.2f %10.1f\n", table, op, count, elapsed, elapsed * 1000000.0 / count);
+}
+
+void nop(void *data) {
+  (void) data;
+}
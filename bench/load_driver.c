@@ -0,0 +1,533 @@
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*----- Local Includes -----*/
+
+#include "../include/histogram.h"
+#include "../include/framer.h"
+
+/*----- Numerical Constants -----*/
+
+#define LOAD_PORT 31100
+#define LOAD_TASKS 100
+#define LOAD_FREQ 1
+#define LOAD_DURATION 30
+#define LOAD_WARMUP 3
+#define LOAD_BATCH 500
+#define LOAD_MAX_MIX 16
+#define LOAD_MAX_ARGS 32
+#define LOAD_ACCEPT_TIMEOUT 10000
+#define LOAD_EXIT_TIMEOUT 10
+#define LOAD_FRAME_BUFSIZE (1 << 18)
+#define LOAD_LINE_LEN 256
+#define LOAD_PASS 0
+#define LOAD_FAIL 1
+#define LOAD_ERROR 2
+
+// Load driver for the monitor. Plays the part of the MiddleMan: takes the monitor's hello,
+// hands it a session so everything happens over one connection, adds tasks in batches,
+// acknowledges reports with keepalives, and measures what comes back. By default it starts
+// the monitor itself, so it can watch its CPU and RSS too, and passes along anything after
+// "--" as extra monitor arguments.
+// Prints a single JSON object, and exits 1 if any threshold given was exceeded, so it can
+// gate CI. Latency is from a report's TIMESTAMP to when we read it, and drift is how far a
+// task's reports have wandered from where its schedule says they should be. Both are only as
+// precise as TIMESTAMP. With a FREQ of at least a second, it also says how many tasks first
+// reported in the busiest and quietest second of the period, which shows how well the
+// monitor spreads tasks out. Give it a duration longer than the period for that.
+// Usage: load_driver [-m monitor | -a pid] [-p port] [-n tasks] [-f freq] [-d secs]
+//                    [-w warmup] [-x TYPE/METRIC[@path],...] [-L p99 latency ms]
+//                    [-D p99 drift ms] [-C cpu percent] [-R rss kB] [-T reports/s] [-v]
+//                    [-- monitor args...]
+
+/*----- Type Declarations -----*/
+
+typedef struct task_mix {
+  char type[16], metric[16], path[PATH_MAX];
+} task_mix_t;
+
+// Struct holds what we know about each task's schedule.
+typedef struct task_state {
+  int reports;
+  double first;
+} task_state_t;
+
+typedef struct proc_sample {
+  double cpu_secs;
+  long rss_kb;
+} proc_sample_t;
+
+/*----- Function Declarations -----*/
+
+int parse_mix(char *spec, task_mix_t *mix);
+int start_listener(int port);
+pid_t spawn_monitor(char *path, int port, char *spool, char **extra, int num_extra, int verbose);
+int accept_monitor(int listener);
+int write_all(int fd, char *buf, int len);
+int next_frame(int fd, char *buf, int len, int timeout);
+int send_tasks(int fd, int num_tasks, double freq, task_mix_t *mix, int num_mix);
+void handle_frame(char *frame);
+void handle_report(char *frame);
+int sample_proc(pid_t pid, proc_sample_t *sample);
+void stop_monitor(pid_t pid);
+void remove_spool(char *spool);
+double wall_now();
+double mono_now();
+void print_histogram(char *name, histogram_t *hist);
+void print_spread();
+void usage();
+
+/*----- Evil but Necessary Globals -----*/
+
+framer_t inbound;
+histogram_t latency, drift;
+task_state_t *states;
+int num_states = 0, acked = 0, nacked = 0, measuring = 0;
+double freq = LOAD_FREQ;
+long reports = 0, measured = 0;
+unsigned long max_seq = 0;
+
+/*----- Function Implementations -----*/
+
+int main(int argc, char **argv) {
+  int c, port = LOAD_PORT, num_tasks = LOAD_TASKS, duration = LOAD_DURATION, warmup = LOAD_WARMUP, verbose = 0;
+  double max_latency = 0, max_drift = 0, max_cpu = 0, min_throughput = 0;
+  long max_rss = 0;
+  char *monitor_path = "bin/monitor", *mix_spec = "TOTAL/MEMORY,SELF,TOTAL/CPU";
+  pid_t pid = 0;
+  task_mix_t mix[LOAD_MAX_MIX];
+
+  while ((c = getopt(argc, argv, "m:a:p:n:f:d:w:x:L:D:C:R:T:v")) != -1) {
+    switch (c) {
+      case 'm': monitor_path = optarg; break;
+      case 'a': pid = atoi(optarg); break;
+      case 'p': port = atoi(optarg); break;
+      case 'n': num_tasks = atoi(optarg); break;
+      case 'f': freq = atof(optarg); break;
+      case 'd': duration = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      case 'x': mix_spec = optarg; break;
+      case 'L': max_latency = atof(optarg); break;
+      case 'D': max_drift = atof(optarg); break;
+      case 'C': max_cpu = atof(optarg); break;
+      case 'R': max_rss = atol(optarg); break;
+      case 'T': min_throughput = atof(optarg); break;
+      case 'v': verbose = 1; break;
+      default: usage();
+    }
+  }
+  int num_mix = parse_mix(mix_spec, mix);
+  if (num_mix <= 0 || num_tasks < 1 || freq < 0.01 || duration <= warmup || warmup < 0) usage();
+
+  states = calloc(num_tasks + 1, sizeof(task_state_t));
+  num_states = num_tasks + 1;
+  if (!states || init_framer(&inbound, LOAD_FRAME_BUFSIZE) || init_histogram(&latency) || init_histogram(&drift)) {
+    fprintf(stderr, "load_driver: out of memory\n");
+    return LOAD_ERROR;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  // Get the monitor talking to us.
+  int listener = start_listener(port);
+  if (listener < 0) {
+    fprintf(stderr, "load_driver: can't listen on port %d: %s\n", port, strerror(errno));
+    return LOAD_ERROR;
+  }
+  char spool[] = "/tmp/notgios-load-XXXXXX";
+  int spawned = !pid;
+  if (spawned) {
+    if (!mkdtemp(spool)) {
+      fprintf(stderr, "load_driver: can't make a spool directory: %s\n", strerror(errno));
+      return LOAD_ERROR;
+    }
+    pid = spawn_monitor(monitor_path, port, spool, argv + optind, argc - optind, verbose);
+    if (pid < 0) return LOAD_ERROR;
+  }
+  int fd = accept_monitor(listener);
+  close(listener);
+  if (fd < 0 || send_tasks(fd, num_tasks, freq, mix, num_mix)) {
+    fprintf(stderr, "load_driver: never got a working connection to the monitor\n");
+    if (spawned) stop_monitor(pid);
+    return LOAD_ERROR;
+  }
+
+  // Consume reports until we're done, acknowledging them every second like the server would.
+  proc_sample_t first = {0, 0}, last = {0, 0};
+  long peak_rss = 0;
+  double started = mono_now(), next_tick = started + 1, measure_start = 0;
+  int lost = 0;
+  char *frame = malloc(LOAD_FRAME_BUFSIZE);
+  while (frame && mono_now() < started + duration) {
+    int retval = next_frame(fd, frame, LOAD_FRAME_BUFSIZE, 100);
+    if (retval < 0) {
+      fprintf(stderr, "load_driver: monitor closed the connection\n");
+      lost = 1;
+      break;
+    } else if (retval > 0) {
+      handle_frame(frame);
+    }
+
+    double now = mono_now();
+    if (!measuring && now >= started + warmup) {
+      measuring = 1;
+      measure_start = now;
+      sample_proc(pid, &first);
+    }
+    if (now >= next_tick) {
+      char keepalive[LOAD_LINE_LEN];
+      int len = snprintf(keepalive, LOAD_LINE_LEN, "NGS STILL THERE?\nACKED %lu\n\n", max_seq);
+      if (write_all(fd, keepalive, len)) break;
+      if (!sample_proc(pid, &last) && last.rss_kb > peak_rss) peak_rss = last.rss_kb;
+      next_tick += 1;
+    }
+  }
+  double elapsed = measuring ? mono_now() - measure_start : 0;
+  sample_proc(pid, &last);
+  if (last.rss_kb > peak_rss) peak_rss = last.rss_kb;
+  free(frame);
+
+  if (spawned) stop_monitor(pid);
+  close(fd);
+  if (spawned) remove_spool(spool);
+
+  // Work out whether we passed, then say so.
+  double throughput = measuring && elapsed > 0 ? measured / elapsed : 0;
+  double cpu = measuring && elapsed > 0 ? (last.cpu_secs - first.cpu_secs) * 100 / elapsed : 0;
+  int pass = !lost;
+  if (max_latency > 0 && histogram_percentile(&latency, 99) / 1000.0 > max_latency) pass = 0;
+  if (max_drift > 0 && histogram_percentile(&drift, 99) / 1000.0 > max_drift) pass = 0;
+  if (max_cpu > 0 && cpu > max_cpu) pass = 0;
+  if (max_rss > 0 && peak_rss > max_rss) pass = 0;
+  if (min_throughput > 0 && throughput < min_throughput) pass = 0;
+
+  printf("{\"tasks\":%d,\"acked\":%d,\"nacked\":%d,\"freq_s\":%g,\"duration_s\":%.3f,", num_tasks, acked, nacked, freq, elapsed);
+  printf("\"reports\":%ld,\"throughput_rps\":%.2f,", measured, throughput);
+  print_histogram("latency_ms", &latency);
+  print_histogram("drift_ms", &drift);
+  print_spread();
+  printf("\"monitor_cpu_pct\":%.2f,\"monitor_rss_kb\":%ld,\"monitor_peak_rss_kb\":%ld,\"pass\":%s}\n",
+      cpu, last.rss_kb, peak_rss, pass ? "true" : "false");
+  return pass ? LOAD_PASS : LOAD_FAIL;
+}
+
+// Function parses a comma separated list of TYPE/METRIC[@path] into mix. Metric defaults to
+// NONE. Returns the number of entries, or -1 if anything's off.
+int parse_mix(char *spec, task_mix_t *mix) {
+  int num = 0;
+  char *copy = strdup(spec), *save, *entry;
+  if (!copy) return -1;
+
+  for (entry = strtok_r(copy, ",", &save); entry; entry = strtok_r(NULL, ",", &save)) {
+    if (num == LOAD_MAX_MIX) break;
+    task_mix_t *current = &mix[num++];
+    memset(current, 0, sizeof(task_mix_t));
+    char *at = strchr(entry, '@'), *slash = strchr(entry, '/');
+    if (at) {
+      *at = '\0';
+      snprintf(current->path, PATH_MAX, "%s", at + 1);
+    }
+    if (slash && (!at || slash < at)) *slash = '\0';
+    snprintf(current->type, sizeof(current->type), "%s", entry);
+    snprintf(current->metric, sizeof(current->metric), "%s", slash && (!at || slash < at) ? slash + 1 : "NONE");
+  }
+  free(copy);
+  return num;
+}
+
+int start_listener(int port) {
+  struct sockaddr_in addr;
+  int fd = socket(AF_INET, SOCK_STREAM, 0), yes = 1;
+  if (fd < 0) return -1;
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, 4)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+pid_t spawn_monitor(char *path, int port, char *spool, char **extra, int num_extra, int verbose) {
+  char port_str[16], *args[LOAD_MAX_ARGS];
+  int num_args = 0;
+
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  args[num_args++] = path;
+  args[num_args++] = "-s";
+  args[num_args++] = "127.0.0.1";
+  args[num_args++] = "-p";
+  args[num_args++] = port_str;
+  args[num_args++] = "-d";
+  args[num_args++] = spool;
+  for (int i = 0; i < num_extra && num_args < LOAD_MAX_ARGS - 1; i++) args[num_args++] = extra[i];
+  args[num_args] = NULL;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (!verbose) {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(null, STDERR_FILENO);
+      dup2(null, STDOUT_FILENO);
+    }
+    execv(path, args);
+    _exit(127);
+  } else if (pid < 0) {
+    fprintf(stderr, "load_driver: can't start %s: %s\n", path, strerror(errno));
+  }
+  return pid;
+}
+
+// Function waits for the monitor's hello, and gives it a session so it keeps the connection
+// instead of waiting for us to dial back.
+int accept_monitor(int listener) {
+  struct pollfd pfd = {listener, POLLIN, 0};
+  char frame[LOAD_LINE_LEN * 4];
+  if (poll(&pfd, 1, LOAD_ACCEPT_TIMEOUT) <= 0) return -1;
+
+  int fd = accept(listener, NULL, NULL);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  if (next_frame(fd, frame, sizeof(frame), LOAD_ACCEPT_TIMEOUT) <= 0 || strstr(frame, "NGS HELLO") != frame) {
+    close(fd);
+    return -1;
+  }
+
+  char reply[LOAD_LINE_LEN];
+  int len = snprintf(reply, LOAD_LINE_LEN, "NGS ACK\nSESSION load-%d\nACKED 0\n\n", (int) getpid());
+  if (write_all(fd, reply, len)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int write_all(int fd, char *buf, int len) {
+  while (len > 0) {
+    int retval = write(fd, buf, len);
+    if (retval > 0) {
+      buf += retval;
+      len -= retval;
+    } else if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      poll(&pfd, 1, 100);
+    } else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Function waits up to timeout milliseconds for a whole frame of at most len bytes. Returns its length, zero if
+// nothing showed up, or -1 if the connection is gone.
+int next_frame(int fd, char *buf, int len, int timeout) {
+  int retval = framer_next(&inbound, buf, len);
+  if (retval != FRAMER_EMPTY) return retval > 0 ? retval : 0;
+
+  struct pollfd pfd = {fd, POLLIN, 0};
+  if (poll(&pfd, 1, timeout) <= 0) return 0;
+  if (framer_fill(&inbound, fd) == FRAMER_CLOSED) return -1;
+  retval = framer_next(&inbound, buf, len);
+  return retval > 0 ? retval : 0;
+}
+
+// Function adds every task, LOAD_BATCH at a time, cycling through the mix. Ids start at 1.
+int send_tasks(int fd, int num_tasks, double freq, task_mix_t *mix, int num_mix) {
+  char *buf = malloc(LOAD_FRAME_BUFSIZE), *frame = malloc(LOAD_FRAME_BUFSIZE);
+  if (!buf || !frame) {
+    free(buf);
+    free(frame);
+    return -1;
+  }
+
+  int retval = 0;
+  for (int start = 1; start <= num_tasks && !retval; start += LOAD_BATCH) {
+    int offset = sprintf(buf, "NGS JOB ADD BATCH\n");
+    for (int id = start; id < start + LOAD_BATCH && id <= num_tasks; id++) {
+      task_mix_t *current = &mix[(id - 1) % num_mix];
+      offset += sprintf(buf + offset, "ID %d\nTYPE %s\nMETRIC %s\nFREQ %g\n", id, current->type, current->metric, freq);
+      if (current->path[0]) offset += snprintf(buf + offset, LOAD_LINE_LEN, "PATH %s\n", current->path);
+      offset += sprintf(buf + offset, "END\n");
+    }
+    strcpy(buf + offset++, "\n");
+    if (write_all(fd, buf, offset)) {
+      retval = -1;
+      break;
+    }
+
+    // Reports can beat the reply back, so keep handling frames until it shows up.
+    int replied = 0;
+    while (!replied) {
+      int len = next_frame(fd, frame, LOAD_FRAME_BUFSIZE, LOAD_ACCEPT_TIMEOUT);
+      if (len <= 0) {
+        retval = -1;
+        break;
+      }
+      replied = strstr(frame, "NGS BATCH REPLY") == frame || strstr(frame, "NGS NACK") == frame;
+      handle_frame(frame);
+    }
+  }
+  free(buf);
+  free(frame);
+  return retval;
+}
+
+void handle_frame(char *frame) {
+  if (strstr(frame, "NGS JOB REPORT") == frame) {
+    handle_report(frame);
+  } else if (strstr(frame, "NGS BATCH REPLY") == frame) {
+    for (char *line = strstr(frame, "\nID "); line; line = strstr(line + 1, "\nID ")) {
+      char *end = strchr(line + 1, '\n');
+      char *status = strstr(line, " NACK");
+      if (status && (!end || status < end)) nacked++;
+      else acked++;
+    }
+  } else if (strstr(frame, "NGS NACK") == frame) {
+    nacked++;
+  }
+}
+
+// Function records a report's latency and how far its task has drifted from its schedule.
+void handle_report(char *frame) {
+  double received = wall_now(), timestamp = 0;
+  unsigned long seq = 0;
+  int id = 0;
+  char *line;
+
+  reports++;
+  if ((line = strstr(frame, "\nID "))) id = atoi(line + 4);
+  if ((line = strstr(frame, "\nTIMESTAMP "))) timestamp = atof(line + 11);
+  if ((line = strstr(frame, "\nSEQ ")) && sscanf(line, "\nSEQ %lu", &seq) == 1 && seq > max_seq) max_seq = seq;
+  if (strstr(frame, "\nFATAL ") || strstr(frame, "\nERROR ") || id <= 0 || id >= num_states) return;
+
+  task_state_t *state = &states[id];
+  if (!state->reports++) state->first = timestamp;
+  if (!measuring) return;
+
+  measured++;
+  double lag = received - timestamp, wander = timestamp - state->first - (state->reports - 1) * freq;
+  histogram_record(&latency, lag > 0 ? lag * 1000000 : 0);
+  histogram_record(&drift, (wander > 0 ? wander : -wander) * 1000000);
+}
+
+int sample_proc(pid_t pid, proc_sample_t *sample) {
+  char path[PATH_MAX], buf[1024];
+  unsigned long user, sys;
+  long pages;
+
+  snprintf(path, PATH_MAX, "/proc/%d/stat", (int) pid);
+  FILE *file = fopen(path, "r");
+  if (!file) return -1;
+  int len = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  buf[len > 0 ? len : 0] = '\0';
+  char *fields = strrchr(buf, ')');
+  if (!fields || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &sys) != 2) return -1;
+
+  snprintf(path, PATH_MAX, "/proc/%d/statm", (int) pid);
+  file = fopen(path, "r");
+  if (!file) return -1;
+  int retval = fscanf(file, "%*d %ld", &pages);
+  fclose(file);
+  if (retval != 1) return -1;
+
+  sample->cpu_secs = (user + sys) / (double) sysconf(_SC_CLK_TCK);
+  sample->rss_kb = pages * (sysconf(_SC_PAGESIZE) / 1024);
+  return 0;
+}
+
+// Function asks the monitor to shut down, and makes sure it does.
+void stop_monitor(pid_t pid) {
+  kill(pid, SIGTERM);
+  for (int i = 0; i < LOAD_EXIT_TIMEOUT * 10; i++) {
+    if (waitpid(pid, NULL, WNOHANG) == pid) return;
+    usleep(100000);
+  }
+  fprintf(stderr, "load_driver: monitor didn't exit after SIGTERM, killing it\n");
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+// Function cleans up after the monitor's spool, which never has subdirectories.
+void remove_spool(char *spool) {
+  char path[PATH_MAX];
+  struct dirent *entry;
+  DIR *directory = opendir(spool);
+  if (!directory) return;
+
+  while ((entry = readdir(directory))) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+    snprintf(path, PATH_MAX, "%s/%s", spool, entry->d_name);
+    unlink(path);
+  }
+  closedir(directory);
+  rmdir(spool);
+}
+
+double wall_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+double mono_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// Function writes a histogram out as a JSON member, converting from microseconds.
+void print_histogram(char *name, histogram_t *hist) {
+  printf("\"%s\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},", name,
+      histogram_percentile(hist, 50) / 1000.0, histogram_percentile(hist, 90) / 1000.0,
+      histogram_percentile(hist, 99) / 1000.0, histogram_max(hist) / 1000.0);
+}
+
+// Function buckets every task by which second of the period its first report fell in. The
+// monitor schedules on the monotonic clock, and TIMESTAMP is wall clock time, so the buckets
+// are shifted from the monitor's by some fraction of a second, which doesn't change the spread.
+void print_spread() {
+  int seconds = (int) freq;
+  if (seconds < 2 || seconds != freq) return;
+
+  int *counts = calloc(seconds, sizeof(int));
+  if (!counts) return;
+  for (int i = 1; i < num_states; i++) {
+    if (!states[i].reports) continue;
+    long first = (long) states[i].first;
+    counts[first % seconds]++;
+  }
+  int least = counts[0], most = counts[0];
+  for (int i = 1; i < seconds; i++) {
+    if (counts[i] < least) least = counts[i];
+    if (counts[i] > most) most = counts[i];
+  }
+  printf("\"phase_per_s\":{\"seconds\":%d,\"min\":%d,\"max\":%d},", seconds, least, most);
+  free(counts);
+}
+
+void usage() {
+  fprintf(stderr, "usage: load_driver [-m monitor | -a pid] [-p port] [-n tasks] [-f freq] [-d secs] [-w warmup]\n"
+      "                   [-x TYPE/METRIC[@path],...] [-L p99 latency ms] [-D p99 drift ms]\n"
+      "                   [-C cpu percent] [-R rss kB] [-T reports/s] [-v] [-- monitor args...]\n");
+  exit(LOAD_ERROR);
+}
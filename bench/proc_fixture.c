@@ -0,0 +1,185 @@
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/*----- Numerical Constants -----*/
+
+#define FIXTURE_PIDS 10000
+#define FIXTURE_MAX_PIDS 65535
+#define FIXTURE_CORES 64
+#define FIXTURE_DISKS 32
+#define FIXTURE_ODD_EVERY 10
+
+// Generator for synthetic procfs trees, so collectors can be pointed at 10k processes, or at
+// formats we don't see on our own boxes, with the monitor's -r option or bin/collect_bench.
+// Put it on tmpfs so it behaves like the real thing. Numbers are made up, but deterministic.
+// Usage: proc_fixture [-p pids] [-c cores] [-d disks] [-o] dir
+// -o gives every tenth process a command name with spaces and parentheses in it, like
+// plenty of real ones have.
+
+/*----- Function Declarations -----*/
+
+int write_file(char *path, char *contents);
+int write_cpu_stats(char *root, int cores);
+int write_meminfo(char *root);
+int write_loadavg(char *root, int pids);
+int write_diskstats(char *root, int disks);
+int write_process(char *root, int pid, int odd);
+unsigned long next_random();
+void usage();
+
+/*----- Evil but Necessary Globals -----*/
+
+unsigned long random_state = 88172645463325252UL;
+
+/*----- Function Implementations -----*/
+
+int main(int argc, char **argv) {
+  int c, pids = FIXTURE_PIDS, cores = FIXTURE_CORES, disks = FIXTURE_DISKS, odd = 0;
+
+  while ((c = getopt(argc, argv, "p:c:d:o")) != -1) {
+    switch (c) {
+      case 'p':
+        pids = atoi(optarg);
+        break;
+      case 'c':
+        cores = atoi(optarg);
+        break;
+      case 'd':
+        disks = atoi(optarg);
+        break;
+      case 'o':
+        odd = 1;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind != argc - 1 || pids < 1 || pids > FIXTURE_MAX_PIDS || cores < 1 || disks < 0) usage();
+
+  char *root = argv[optind];
+  if (mkdir(root, 0755) && errno != EEXIST) {
+    fprintf(stderr, "proc_fixture: can't create %s: %s\n", root, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  int retval = write_cpu_stats(root, cores) || write_meminfo(root) || write_loadavg(root, pids) || write_diskstats(root, disks);
+  for (int pid = 1; pid <= pids && !retval; pid++) {
+    retval = write_process(root, pid, odd && pid % FIXTURE_ODD_EVERY == 0);
+  }
+
+  // Collectors check that their own process looks sane before blaming the process they're
+  // watching, so self has to exist too.
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/self", root);
+  unlink(path);
+  if (!retval && symlink("1", path)) retval = -1;
+
+  if (retval) {
+    fprintf(stderr, "proc_fixture: failed writing under %s: %s\n", root, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  printf("proc_fixture: %d processes, %d cores, %d disks under %s\n", pids, cores, disks, root);
+  return EXIT_SUCCESS;
+}
+
+int write_file(char *path, char *contents) {
+  FILE *file = fopen(path, "w");
+  if (!file) return -1;
+  int retval = fputs(contents, file) < 0;
+  return fclose(file) || retval ? -1 : 0;
+}
+
+int write_cpu_stats(char *root, int cores) {
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/stat", root);
+  FILE *file = fopen(path, "w");
+  if (!file) return -1;
+
+  // Aggregate line first, like the kernel does, then one per core.
+  for (int i = -1; i < cores; i++) {
+    unsigned long scale = i < 0 ? cores : 1;
+    if (i < 0) fprintf(file, "cpu ");
+    else fprintf(file, "cpu%d", i);
+    fprintf(file, " %lu %lu %lu %lu %lu %lu %lu 0 0 0\n", scale * (next_random() % 1000000), scale * (next_random() % 10000),
+        scale * (next_random() % 500000), scale * (10000000 + next_random() % 1000000), scale * (next_random() % 50000),
+        scale * (next_random() % 1000), scale * (next_random() % 5000));
+  }
+  fprintf(file, "intr %lu\nctxt %lu\nbtime 1700000000\nprocesses %lu\nprocs_running 2\nprocs_blocked 0\n",
+      next_random() % 100000000, next_random() % 100000000, next_random() % 1000000);
+  return fclose(file);
+}
+
+int write_meminfo(char *root) {
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/meminfo", root);
+  return write_file(path,
+      "MemTotal:       65831132 kB\n"
+      "MemFree:         2134876 kB\n"
+      "MemAvailable:   41230012 kB\n"
+      "Buffers:         1042212 kB\n"
+      "Cached:         36112904 kB\n"
+      "SwapCached:            0 kB\n"
+      "Active:         30213412 kB\n"
+      "Inactive:       27100832 kB\n"
+      "SwapTotal:       8388604 kB\n"
+      "SwapFree:        8388604 kB\n");
+}
+
+int write_loadavg(char *root, int pids) {
+  char path[PATH_MAX], contents[64];
+  snprintf(path, PATH_MAX, "%s/loadavg", root);
+  snprintf(contents, sizeof(contents), "0.52 0.58 0.59 2/%d %d\n", pids, pids);
+  return write_file(path, contents);
+}
+
+int write_diskstats(char *root, int disks) {
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/diskstats", root);
+  FILE *file = fopen(path, "w");
+  if (!file) return -1;
+
+  for (int i = 0; i < disks; i++) {
+    fprintf(file, "%4d %7d sd%c%c", 8 + i / 16 * 57, i % 16 * 16, 'a' + i / 26, 'a' + i % 26);
+    for (int j = 0; j < 17; j++) fprintf(file, " %lu", next_random() % 10000000);
+    fprintf(file, "\n");
+  }
+  return fclose(file);
+}
+
+int write_process(char *root, int pid, int odd) {
+  char path[PATH_MAX], contents[512];
+  snprintf(path, PATH_MAX, "%s/%d", root, pid);
+  if (mkdir(path, 0755) && errno != EEXIST) return -1;
+
+  // Everything up to num_threads, which is as far as anything of ours reads.
+  snprintf(path, PATH_MAX, "%s/%d/stat", root, pid);
+  snprintf(contents, sizeof(contents), "%d (%s%d) S 1 %d %d 0 -1 4194560 %lu 0 0 0 %lu %lu 0 0 20 0 %lu 0 %lu %lu %lu\n",
+      pid, odd ? "odd (name) " : "proc", pid, pid, pid, next_random() % 100000, next_random() % 100000, next_random() % 50000,
+      1 + next_random() % 8, next_random() % 1000000, 4096 * (1000 + next_random() % 100000), 1000 + next_random() % 10000);
+  if (write_file(path, contents)) return -1;
+
+  snprintf(path, PATH_MAX, "%s/%d/statm", root, pid);
+  unsigned long size = 1000 + next_random() % 100000;
+  snprintf(contents, sizeof(contents), "%lu %lu %lu %lu 0 %lu 0\n", size, size / 4, size / 8, size / 32, size / 2);
+  return write_file(path, contents);
+}
+
+// Function is xorshift64, so fixtures come out the same every time.
+unsigned long next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+void usage() {
+  fprintf(stderr, "usage: proc_fixture [-p pids] [-c cores] [-d disks] [-o] dir\n");
+  exit(EINVAL);
+}
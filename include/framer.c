@@ -0,0 +1,147 @@
+/*----- System Includes -----*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*----- Local Includes -----*/
+
+#include "framer.h"
+
+/*----- Internal Function Declarations -----*/
+
+int find_delimiter(framer_t *frm);
+void copy_out(framer_t *frm, char *buf, int len);
+
+/*----- Framer Functions -----*/
+
+int setup_framer(framer_t *frm, int size) {
+  // Size has to be a power of two so that indices can wrap with a mask.
+  if (size < 2 || (size & (size - 1))) return FRAMER_INVAL;
+
+  frm->ring = malloc(size);
+  if (!frm->ring) return FRAMER_NOMEM;
+  frm->size = size;
+  framer_clear(frm);
+  return FRAMER_SUCCESS;
+}
+
+// Function is responsible for creating a framer struct.
+framer_t *create_framer(int size) {
+  framer_t *frm = malloc(sizeof(framer_t));
+
+  if (frm) {
+    frm->dynamic = 1;
+    if (setup_framer(frm, size) != FRAMER_SUCCESS) {
+      free(frm);
+      frm = NULL;
+    }
+  }
+
+  return frm;
+}
+
+int init_framer(framer_t *frm, int size) {
+  if (frm) {
+    frm->dynamic = 0;
+    return setup_framer(frm, size);
+  }
+  return FRAMER_INVAL;
+}
+
+// Function performs a single read from fd into whatever space is left in the ring.
+// Meant to be called once per readiness notification on a non-blocking socket.
+// Returns the number of bytes read (which may be zero if the read would have blocked),
+// or FRAMER_CLOSED if the other end has gone away.
+int framer_fill(framer_t *frm, int fd) {
+  // Validate given parameters.
+  if (!frm) return FRAMER_INVAL;
+
+  // If we're full, the frame at the front can't possibly fit. Hold on to the last byte, in
+  // case it's the first half of the delimiter, and throw out everything else until the
+  // end of the frame shows up.
+  if (frm->len == frm->size) {
+    frm->start = (frm->start + frm->len - 1) & (frm->size - 1);
+    frm->len = 1;
+    frm->scanned = 1;
+    frm->discarding = 1;
+  }
+
+  // Free space may wrap, but a single read only ever fills the contiguous part of it.
+  int tail = (frm->start + frm->len) & (frm->size - 1);
+  int space = tail >= frm->start ? frm->size - tail : frm->start - tail;
+  if (space > frm->size - frm->len) space = frm->size - frm->len;
+
+  int retval = read(fd, frm->ring + tail, space);
+  if (retval > 0) {
+    frm->len += retval;
+    return retval;
+  } else if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return 0;
+  }
+  return FRAMER_CLOSED;
+}
+
+// Function pulls the next complete frame, including its delimiter, out of the ring and
+// copies it into buf as a null terminated string.
+// Returns the length of the frame, FRAMER_EMPTY if no complete frame is buffered, or
+// FRAMER_TOOBIG if a frame was consumed but couldn't fit into buf (or the ring).
+int framer_next(framer_t *frm, char *buf, int len) {
+  // Validate given parameters.
+  if (!frm || !buf || len <= 0) return FRAMER_INVAL;
+
+  int frame_len = find_delimiter(frm);
+  if (frame_len < 0) return FRAMER_EMPTY;
+
+  int retval = frame_len;
+  if (frm->discarding || frame_len >= len) {
+    frm->discarding = 0;
+    retval = FRAMER_TOOBIG;
+  } else {
+    copy_out(frm, buf, frame_len);
+    buf[frame_len] = '\0';
+  }
+
+  frm->start = (frm->start + frame_len) & (frm->size - 1);
+  frm->len -= frame_len;
+  frm->scanned = 0;
+  return retval;
+}
+
+void framer_clear(framer_t *frm) {
+  frm->start = 0;
+  frm->len = 0;
+  frm->scanned = 0;
+  frm->discarding = 0;
+}
+
+void destroy_framer(framer_t *frm) {
+  free(frm->ring);
+  if (frm->dynamic) free(frm);
+}
+
+/*----- Internal Functions -----*/
+
+// Function searches for the end of the frame at the front of the ring, picking up where the
+// last search left off so that every byte only gets looked at once.
+// Returns the length of the frame, including the delimiter, or -1 if it isn't here yet.
+int find_delimiter(framer_t *frm) {
+  int mask = frm->size - 1;
+  char prev = frm->scanned ? frm->ring[(frm->start + frm->scanned - 1) & mask] : '\0';
+  for (int i = frm->scanned; i < frm->len; i++) {
+    char curr = frm->ring[(frm->start + i) & mask];
+    if (prev == '\n' && curr == '\n') return i + 1;
+    prev = curr;
+  }
+  frm->scanned = frm->len;
+  return -1;
+}
+
+// Function copies len bytes off the front of the ring, handling wraparound.
+void copy_out(framer_t *frm, char *buf, int len) {
+  int first = frm->size - frm->start;
+  if (first > len) first = len;
+  memcpy(buf, frm->ring + frm->start, first);
+  memcpy(buf + first, frm->ring, len - first);
+}
@@ -0,0 +1,33 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+
+/*----- Numerical Constants -----*/
+
+#define FRAMER_SUCCESS 0x0
+#define FRAMER_NOMEM -0x01
+#define FRAMER_INVAL -0x02
+#define FRAMER_EMPTY -0x04
+#define FRAMER_TOOBIG -0x08
+#define FRAMER_CLOSED -0x10
+
+/*----- Type Declarations -----*/
+
+// Struct represents a ring buffer sitting in front of a stream socket that splits the
+// stream into "\n\n" terminated frames. Not threadsafe, belongs to whoever reads the socket.
+// Bytes past the end of a frame are kept for the next call, so any number of frames can
+// arrive in a single read.
+typedef struct framer {
+  char *ring;
+  int size, start, len, scanned, discarding, dynamic;
+} framer_t;
+
+/*----- Function Declarations -----*/
+
+framer_t *create_framer(int size);
+int init_framer(framer_t *frm, int size);
+int framer_fill(framer_t *frm, int fd);
+int framer_next(framer_t *frm, char *buf, int len);
+void framer_clear(framer_t *frm);
+void destroy_framer(framer_t *frm);
+
+#endif
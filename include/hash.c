@@ -9,45 +9,81 @@
 
 /*----- Type Declarations -----*/
 
-// Node struct used for chaining hash collision resolution.
-struct hash_node {
-  char *key;
+// Slot struct for the table itself. dist is how far the slot is from where its hash says
+// it should be, plus one, so zero means the slot is empty. The hash is cached so that
+// probing and rehashing never have to look at the key unless the hashes match. Short
+// keys, which is every task id we've ever seen, live right in the slot.
+struct hash_slot {
+  uint64_t hash;
+  uint32_t dist, len;
+  union {
+    char inline_key[HASH_INLINE_KEY];
+    char *key;
+  };
   void *data;
-  struct hash_node *next;
 };
 
 /*----- Internal Function Declarations -----*/
 
-hash_node_t *create_hash_node(char *key, void *data);
-int insert_hash_node(hash_node_t *head, hash_node_t *insert);
-hash_node_t *find_hash_node(hash_node_t *head, char *key);
-hash_node_t *remove_hash_node(hash_node_t *head, char *key, void (*destruct) (void *));
-void destroy_hash_chain(hash_node_t *head, void (*destruct) (void *));
-void destroy_hash_node(hash_node_t *node, void (*destruct) (void *));
+int setup_hash(hash_t *table, void (*destruct) (void *), int num_stripes);
+hash_stripe_t *find_stripe(hash_t *table, uint64_t hash);
+hash_slot_t *find_hash_slot(hash_stripe_t *stripe, char *key, int len, uint64_t hash);
+int insert_hash_slot(hash_slot_t *data, int size, hash_slot_t *insert);
+void remove_hash_slot(hash_stripe_t *stripe, int pos);
+char *slot_key(hash_slot_t *slot);
+int rehash(hash_stripe_t *stripe);
+void lock_stripes(hash_t *table, int write);
+void unlock_stripes(hash_t *table);
 
 /*----- Hash Functions -----*/
 
-int setup_hash(hash_t *table, void (*destruct) (void *)) {
-  // Allocate table with calloc to allow for NULL checks.
-  int retval = pthread_rwlock_init(&table->lock, NULL);
-  table->data = calloc(HASH_START_SIZE, sizeof(hash_node_t *));
-  if (table->data && !retval) {
-    table->destruct = destruct;
-    table->count = 0;
-    table->frozen = 0;
-    table->size = HASH_START_SIZE;
-    return 1;
+int setup_hash(hash_t *table, void (*destruct) (void *), int num_stripes) {
+  // Stripe count has to be a power of two so that hashes can be masked into it.
+  if (num_stripes < 1 || num_stripes > HASH_MAX_STRIPES || (num_stripes & (num_stripes - 1))) return HASH_INVAL;
+
+  table->stripes = calloc(num_stripes, sizeof(hash_stripe_t));
+  if (!table->stripes) return HASH_NOMEM;
+
+  // Allocate each stripe with calloc so every slot starts out empty.
+  for (int i = 0; i < num_stripes; i++) {
+    hash_stripe_t *stripe = &table->stripes[i];
+    stripe->data = calloc(HASH_START_SIZE, sizeof(hash_slot_t));
+    if (!stripe->data || pthread_rwlock_init(&stripe->lock, NULL)) {
+      free(stripe->data);
+      for (int j = 0; j < i; j++) {
+        free(table->stripes[j].data);
+        pthread_rwlock_destroy(&table->stripes[j].lock);
+      }
+      free(table->stripes);
+      return HASH_NOMEM;
+    }
+    stripe->size = HASH_START_SIZE;
   }
-  return 0;
+  table->destruct = destruct;
+  table->count = 0;
+  table->frozen = 0;
+  table->num_stripes = num_stripes;
+  return HASH_SUCCESS;
 }
 
 // Function handles creation of a hash struct.
 hash_t *create_hash(void (*destruct) (void *)) {
+  return create_striped_hash(destruct, 1);
+}
+
+int init_hash(hash_t *table, void (*destruct) (void *)) {
+  return init_striped_hash(table, destruct, 1);
+}
+
+// Function handles creation of a hash struct meant to be hammered on by several threads at
+// once. num_stripes must be a power of two.
+hash_t *create_striped_hash(void (*destruct) (void *), int num_stripes) {
+  if (!destruct) return NULL;
   hash_t *table = malloc(sizeof(hash_t));
 
   if (table) {
     table->dynamic = 1;
-    if (!setup_hash(table, destruct)) {
+    if (setup_hash(table, destruct, num_stripes) != HASH_SUCCESS) {
       free(table);
       table = NULL;
     }
@@ -56,66 +92,36 @@ hash_t *create_hash(void (*destruct) (void *)) {
   return table;
 }
 
-int init_hash(hash_t *table, void (*destruct) (void *)) {
+int init_striped_hash(hash_t *table, void (*destruct) (void *), int num_stripes) {
   if (table && destruct) {
     table->dynamic = 0;
-    if (setup_hash(table, destruct)) return HASH_SUCCESS;
-    else return HASH_NOMEM;
+    return setup_hash(table, destruct, num_stripes);
   }
   return HASH_INVAL;
 }
 
-// Function handles creation of a hash value for a given string.
-int hash_key(char *key, int size) {
-  int proto_hash = 0;
-  for (unsigned int i = 0; i < strlen(key); i++) {
-    proto_hash += (int) key[i];
-  }
-  return proto_hash % size;
-}
-
-// Function handles the rehash process encountered when a hash reaches
-// 80% capacity. Hate locking the entire function, but we're rehashing, so it's
-// pretty much unavoidable.
-void rehash(hash_t *table) {
-  // Acquire write-lock for hash.
-  pthread_rwlock_wrlock(&table->lock);
-
-  // Abort rehash if we're frozen.
-  if (table->frozen) {
-    pthread_rwlock_unlock(&table->lock);
-    return;
+// Function handles the rehash process encountered when a stripe reaches 80% capacity.
+// Only ever called with the stripe's write lock held, and only ever moves that stripe's
+// share of the table, so a rehash stalls 1/num_stripes of the readers for 1/num_stripes of
+// the time a whole-table rehash would.
+int rehash(hash_stripe_t *stripe) {
+  // Allocate new table with calloc so every slot starts out empty.
+  hash_slot_t *new_data = calloc(stripe->size * 2, sizeof(hash_slot_t));
+  if (!new_data) return HASH_NOMEM;
+
+  // Cached hashes mean moving everything over never touches a key.
+  for (int i = 0; i < stripe->size; i++) {
+    hash_slot_t slot = stripe->data[i];
+    if (!slot.dist) continue;
+    slot.dist = 1;
+    insert_hash_slot(new_data, stripe->size * 2, &slot);
   }
 
-  // Allocate new table with calloc to allow for NULL checks.
-  hash_node_t **new_data = calloc(table->size * 2, sizeof(hash_node_t *));
-
-  // Copy all previous data into new, larger, hash.
-  hash_node_t **old_data = table->data;
-  for(int i = 0; i < table->size; i++) {
-    hash_node_t *current = old_data[i];
-    while (current) {
-      hash_node_t *tmp = current->next;
-      current->next = NULL;
-
-      // Calculate new hash value and insert.
-      int hash = hash_key(current->key, table->size * 2);
-      if (new_data[hash]) {
-        insert_hash_node(new_data[hash], current);
-      } else {
-        new_data[hash] = current;
-      }
-      current = tmp;
-    }
-  }
-
-  // Update hash struct with changes.
-  table->data = new_data;
-  table->size *= 2;
-  free(old_data);
-
-  // Relinquish write-lock.
-  pthread_rwlock_unlock(&table->lock);
+  // Update stripe with changes.
+  free(stripe->data);
+  stripe->data = new_data;
+  stripe->size *= 2;
+  return HASH_SUCCESS;
 }
 
 // Insert data into a hash for a specific key.
@@ -123,155 +129,220 @@ int hash_put(hash_t *table, char *key, void *data) {
   // Verify parameters.
   if (!table || !key || !data) return HASH_INVAL;
 
-  // Check if table needs a rehash.
-  if (table->count / (float) table->size > 0.8) rehash(table);
+  // Generate hash value before taking the lock.
+  int len = strlen(key);
+  uint64_t hash = hash_bytes(key, len);
+  hash_stripe_t *stripe = find_stripe(table, hash);
 
-  // Generate hash value and insert.
-  int hash = hash_key(key, table->size);
-
-  // Acquire write lock.
-  pthread_rwlock_rdlock(&table->lock);
+  // Acquire write lock. Checking for the key and inserting it have to happen under the
+  // same lock, otherwise two threads could both decide the key is new.
+  pthread_rwlock_wrlock(&stripe->lock);
 
   // Abort if we're frozen.
   if (table->frozen) {
-    pthread_rwlock_unlock(&table->lock);
+    pthread_rwlock_unlock(&stripe->lock);
     return HASH_FROZEN;
   }
 
   // Verify that table does not already contain given key.
-  if (table->data[hash]) {
-    // Check if we're dealing with a hash collision, or a repeat key.
-    if (!find_hash_node(table->data[hash], key)) {
-      // Data is new.
-      hash_node_t *node = create_hash_node(key, data);
-
-      // Probably stupid, but taking the read lock first lets us get through the whole function
-      // without ever acquiring the write lock if we don't have to rehash and the data already
-      // exists.
-      pthread_rwlock_unlock(&table->lock);
-      pthread_rwlock_wrlock(&table->lock);
-
-      insert_hash_node(table->data[hash], node);
-      table->count++;
-      pthread_rwlock_unlock(&table->lock);
-      return HASH_SUCCESS;
-    } else {
-      // Key already exists in table.
-      pthread_rwlock_unlock(&table->lock);
-      return HASH_EXISTS;
-    }
-  } else {
-    hash_node_t *node = create_hash_node(key, data);
-
-    // Probably stupid, but taking the read lock first lets us get through the whole function
-    // without ever acquiring the write lock if we don't have to rehash, and the data already
-    // exists.
-    pthread_rwlock_unlock(&table->lock);
-    pthread_rwlock_wrlock(&table->lock);
+  if (find_hash_slot(stripe, key, len, hash)) {
+    pthread_rwlock_unlock(&stripe->lock);
+    return HASH_EXISTS;
+  }
 
-    // Insert new data into table.
-    table->data[hash] = node;
-    table->count++;
+  // Check if stripe needs a rehash.
+  if ((stripe->count + 1) * 5 > stripe->size * 4 && rehash(stripe) != HASH_SUCCESS) {
+    pthread_rwlock_unlock(&stripe->lock);
+    return HASH_NOMEM;
+  }
 
-    pthread_rwlock_unlock(&table->lock);
-    return HASH_SUCCESS;
+  // Copy given string so it can't be freed out from under us.
+  hash_slot_t slot;
+  slot.hash = hash;
+  slot.dist = 1;
+  slot.len = len;
+  slot.data = data;
+  if (len < HASH_INLINE_KEY) {
+    memcpy(slot.inline_key, key, len + 1);
+  } else if ((slot.key = malloc(sizeof(char) * (len + 1)))) {
+    memcpy(slot.key, key, len + 1);
+  } else {
+    pthread_rwlock_unlock(&stripe->lock);
+    return HASH_NOMEM;
   }
+
+  insert_hash_slot(stripe->data, stripe->size, &slot);
+  stripe->count++;
+  __atomic_add_fetch(&table->count, 1, __ATOMIC_RELAXED);
+  pthread_rwlock_unlock(&stripe->lock);
+  return HASH_SUCCESS;
 }
 
 // Function handles getting data out of a hash for a specific key.
 void *hash_get(hash_t *table, char *key) {
   // Verify parameters.
-  if (!table || !table->count || !key) return NULL;
+  if (!table || !key) return NULL;
 
   // Generate hash value.
-  int hash = hash_key(key, table->size);
+  int len = strlen(key);
+  uint64_t hash = hash_bytes(key, len);
+  hash_stripe_t *stripe = find_stripe(table, hash);
 
   // Acquire read-lock and find it.
-  pthread_rwlock_rdlock(&table->lock);
-  hash_node_t *found = find_hash_node(table->data[hash], key);
-
-  if (found) {
-    void *data = found->data;
-    pthread_rwlock_unlock(&table->lock);
-    return data;
-  } else {
-    pthread_rwlock_unlock(&table->lock);
-    return NULL;
-  }
+  pthread_rwlock_rdlock(&stripe->lock);
+  hash_slot_t *found = find_hash_slot(stripe, key, len, hash);
+  void *data = found ? found->data : NULL;
+  pthread_rwlock_unlock(&stripe->lock);
 
+  return data;
 }
 
-// Handle removal of a key from hash. Although never actually called in the
-// project, it seemed dishonest not to include it.
+// Handle removal of a key from hash.
 int hash_drop(hash_t *table, char *key) {
   // Verify parameters.
-  if (!table || table->count == 0 || !key) return HASH_INVAL;
+  if (!table || !key) return HASH_INVAL;
 
-  // Generate hash value and find data.
-  int hash = hash_key(key, table->size);
+  // Generate hash value.
+  int len = strlen(key);
+  uint64_t hash = hash_bytes(key, len);
+  hash_stripe_t *stripe = find_stripe(table, hash);
 
-  // Acquire read lock for searching.
-  pthread_rwlock_rdlock(&table->lock);
+  // Acquire write lock.
+  pthread_rwlock_wrlock(&stripe->lock);
 
   // Abort if we're frozen.
   if (table->frozen) {
-    pthread_rwlock_unlock(&table->lock);
+    pthread_rwlock_unlock(&stripe->lock);
     return HASH_FROZEN;
   }
 
-  if (table->data[hash]) {
-    if (find_hash_node(table->data[hash], key)) {
-      // We found it. Switch locks for writing.
-      pthread_rwlock_unlock(&table->lock);
-      pthread_rwlock_wrlock(&table->lock);
-
-      // Remove the data.
-      table->data[hash] = remove_hash_node(table->data[hash], key, table->destruct);
-      table->count--;
-      pthread_rwlock_unlock(&table->lock);
-      return HASH_SUCCESS;
-    } else {
-      // Key does not exist in table.
-      pthread_rwlock_unlock(&table->lock);
-      return HASH_NOTFOUND;
-    }
-  } else {
+  hash_slot_t *found = find_hash_slot(stripe, key, len, hash);
+  if (!found) {
     // Key does not exist in table.
-    pthread_rwlock_unlock(&table->lock);
+    pthread_rwlock_unlock(&stripe->lock);
     return HASH_NOTFOUND;
   }
+
+  // Remove the data.
+  if (found->len >= HASH_INLINE_KEY) free(found->key);
+  table->destruct(found->data);
+  remove_hash_slot(stripe, found - stripe->data);
+  __atomic_sub_fetch(&table->count, 1, __ATOMIC_RELAXED);
+
+  pthread_rwlock_unlock(&stripe->lock);
+  return HASH_SUCCESS;
 }
 
 // Function handles the enumeration of all keys currently stored in hash.
-// Returns said keys in any order.
+// Returns copies of said keys in any order, in a single NULL terminated allocation, so the
+// caller only has to free the array and can drop keys from the table while iterating.
+// Every stripe is read-locked for the duration, so the keys are a consistent snapshot.
 char **hash_keys(hash_t *table) {
   if (!table) return NULL;
 
-  // Allocate key array.
-  int current = 0;
-  char **keys = (char **) malloc(sizeof(char *) * table->count);
-
-  // Iterate across each array index, and each hash_node chain.
-  pthread_rwlock_rdlock(&table->lock);
-  for (int i = 0; i < table->size; i++) {
-    if (table->data[i]) {
-      for (hash_node_t *tmp = table->data[i]; tmp; tmp = tmp->next) {
-        keys[current] = tmp->key;
-        current++;
+  lock_stripes(table, 0);
+
+  // Figure out how much space the copies need.
+  int count = 0;
+  size_t bytes = 0;
+  for (int i = 0; i < table->num_stripes; i++) {
+    hash_stripe_t *stripe = &table->stripes[i];
+    for (int j = 0; j < stripe->size; j++) {
+      if (stripe->data[j].dist) bytes += stripe->data[j].len + 1;
+    }
+    count += stripe->count;
+  }
+
+  // Allocate key array, with the strings packed in behind the pointers.
+  char **keys = malloc(sizeof(char *) * (count + 1) + bytes);
+  if (keys) {
+    char **current = keys, *strings = (char *) (keys + count + 1);
+    for (int i = 0; i < table->num_stripes; i++) {
+      hash_stripe_t *stripe = &table->stripes[i];
+      for (int j = 0; j < stripe->size; j++) {
+        hash_slot_t *slot = &stripe->data[j];
+        if (!slot->dist) continue;
+        memcpy(strings, slot_key(slot), slot->len + 1);
+        *current++ = strings;
+        strings += slot->len + 1;
       }
     }
+    *current = NULL;
   }
-  pthread_rwlock_unlock(&table->lock);
+  unlock_stripes(table);
 
   return keys;
 }
 
+// Function calls visit on every entry in the table, in any order, without allocating.
+// Every stripe is read-locked for the duration, so visit sees a consistent snapshot, and
+// must not call back into the table. Stops early if visit returns nonzero.
+// Returns whatever visit stopped on, or zero if everything was visited.
+int hash_foreach(hash_t *table, int (*visit) (char *, void *, void *), void *arg) {
+  if (!table || !visit) return HASH_INVAL;
+
+  int retval = 0;
+  lock_stripes(table, 0);
+  for (int i = 0; i < table->num_stripes && !retval; i++) {
+    hash_stripe_t *stripe = &table->stripes[i];
+    for (int j = 0; j < stripe->size && !retval; j++) {
+      hash_slot_t *slot = &stripe->data[j];
+      if (slot->dist) retval = visit(slot_key(slot), slot->data, arg);
+    }
+  }
+  unlock_stripes(table);
+
+  return retval;
+}
+
+// Function drops every entry for which matches returns nonzero, all under the write locks,
+// so nothing can sneak in or out halfway through. matches is called exactly once per entry
+// and must not call back into the table.
+// Returns the number of entries dropped.
+int hash_drain(hash_t *table, int (*matches) (char *, void *, void *), void *arg) {
+  if (!table || !matches) return HASH_INVAL;
+
+  int dropped = 0;
+  lock_stripes(table, 1);
+  if (table->frozen) {
+    unlock_stripes(table);
+    return HASH_FROZEN;
+  }
+
+  for (int i = 0; i < table->num_stripes; i++) {
+    hash_stripe_t *stripe = &table->stripes[i];
+    int mask = stripe->size - 1, start = 0;
+
+    // Removal shifts later entries back by one, so start the sweep just past an empty slot.
+    // Nothing can ever shift back across it, so every entry is seen exactly once.
+    while (stripe->data[start].dist) start++;
+    for (int j = 1; j <= stripe->size; j++) {
+      int pos = (start + j) & mask;
+      hash_slot_t *slot = &stripe->data[pos];
+
+      // Keep looking at the same slot for as long as we keep removing whatever's in it.
+      while (slot->dist && matches(slot_key(slot), slot->data, arg)) {
+        if (slot->len >= HASH_INLINE_KEY) free(slot->key);
+        table->destruct(slot->data);
+        remove_hash_slot(stripe, pos);
+        dropped++;
+      }
+    }
+  }
+  __atomic_sub_fetch(&table->count, dropped, __ATOMIC_RELAXED);
+  unlock_stripes(table);
+
+  return dropped;
+}
+
 void hash_freeze(hash_t *table) {
   if (!table) return;
 
-  pthread_rwlock_wrlock(&table->lock);
+  // Writers check frozen under their stripe's lock, so holding all of them guarantees no
+  // write is halfway through when we flip it.
+  lock_stripes(table, 1);
   table->frozen = 1;
-  pthread_rwlock_unlock(&table->lock);
+  unlock_stripes(table);
 }
 
 // Function handles the destruction of hash struct.
@@ -279,124 +350,178 @@ void destroy_hash(hash_t *table) {
   // Verify parameters.
   if (!table) return;
 
-  // Get the write lock, just in case some poor soul is still trying to read data out.
-  pthread_rwlock_wrlock(&table->lock);
-  if (table->count > 0) {
-    // Destroy all necessary data.
-    for (int i = 0; i < table->size; i++) {
-      hash_node_t *node = table->data[i];
-      if (node) destroy_hash_chain(node, table->destruct);
+  // Get the write locks, just in case some poor soul is still trying to read data out.
+  lock_stripes(table, 1);
+  for (int i = 0; i < table->num_stripes; i++) {
+    hash_stripe_t *stripe = &table->stripes[i];
+    for (int j = 0; j < stripe->size && stripe->count > 0; j++) {
+      hash_slot_t *slot = &stripe->data[j];
+      if (!slot->dist) continue;
+      if (slot->len >= HASH_INLINE_KEY) free(slot->key);
+      table->destruct(slot->data);
     }
+    free(stripe->data);
   }
-  free(table->data);
 
   // Finish the job.
-  pthread_rwlock_unlock(&table->lock);
-  pthread_rwlock_destroy(&table->lock);
+  unlock_stripes(table);
+  for (int i = 0; i < table->num_stripes; i++) pthread_rwlock_destroy(&table->stripes[i].lock);
+  free(table->stripes);
   if (table->dynamic) free(table);
 }
 
-/*---- Hash Node Functions ----*/
+/*---- Stripe Functions ----*/
 
-// Function handles the creation of a hash_node struct.
-hash_node_t *create_hash_node(char *key, void *data) {
-  hash_node_t *node = malloc(sizeof(hash_node_t));
+// Function picks the stripe for a hash. Uses the high half of the hash, since the low
+// bits pick the slot within the stripe.
+hash_stripe_t *find_stripe(hash_t *table, uint64_t hash) {
+  return &table->stripes[(hash >> 32) & (table->num_stripes - 1)];
+}
 
-  if (node) {
-    // Copy given string so it can't be freed out from under us.
-    char *intern_key = (char *) malloc(sizeof(char) * (strlen(key) + 1));
-    if (intern_key) {
-      strcpy(intern_key, key);
-      node->key = intern_key;
-      node->data = data;
-      node->next = NULL;
-    } else {
-      // Key could not be copied. Continued initialization impossible.
-      free(node);
-      node = NULL;
-    }
+// Function locks every stripe, always in the same order so two callers can't deadlock.
+void lock_stripes(hash_t *table, int write) {
+  for (int i = 0; i < table->num_stripes; i++) {
+    if (write) pthread_rwlock_wrlock(&table->stripes[i].lock);
+    else pthread_rwlock_rdlock(&table->stripes[i].lock);
   }
+}
 
-  return node;
+void unlock_stripes(hash_t *table) {
+  for (int i = table->num_stripes - 1; i >= 0; i--) pthread_rwlock_unlock(&table->stripes[i].lock);
 }
 
-// Function handles inserting a hash node into a linked list of hash nodes.
-int insert_hash_node(hash_node_t *head, hash_node_t *insert) {
-  // Validate paramaters and insert if the list doesn't already contain
-  // the given node.
-  if (head && insert) {
-    for (hash_node_t *current = head; current; current = current->next) {
-      if (!strcmp(insert->key, current->key)) {
-        return 0;
-      } else if(!current->next) {
-        current->next = insert;
-        return 1;
-      }
+/*----- Hash Value Functions -----*/
+
+// Pieces of wyhash (final version 4), which is public domain. Fast on short keys, which
+// is all we ever hash, and doesn't fall over on keys that only differ in a digit or two.
+static const uint64_t wy_secret[4] = {
+  0x2d358dccaa6c78a5ull,
+  0x8bb84b93962eacc9ull,
+  0x4b33a62ed433d4a3ull,
+  0x4d5a2da51de1aa47ull
+};
+
+static inline void wy_mum(uint64_t *a, uint64_t *b) {
+  __uint128_t r = *a;
+  r *= *b;
+  *a = (uint64_t) r;
+  *b = (uint64_t) (r >> 64);
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+  wy_mum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t wy_read8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t wy_read4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t wy_read3(const uint8_t *p, int k) {
+  return (((uint64_t) p[0]) << 16) | (((uint64_t) p[k >> 1]) << 8) | p[k - 1];
+}
+
+// Function handles creation of a hash value for a given string.
+uint64_t hash_bytes(const char *key, int len) {
+  const uint8_t *p = (const uint8_t *) key;
+  uint64_t seed = wy_mix(wy_secret[0], wy_secret[1]), a, b;
+
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (wy_read4(p) << 32) | wy_read4(p + ((len >> 3) << 2));
+      b = (wy_read4(p + len - 4) << 32) | wy_read4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = wy_read3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
     }
-    return 0;
   } else {
-    return 0;
+    int i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wy_mix(wy_read8(p) ^ wy_secret[1], wy_read8(p + 8) ^ seed);
+        see1 = wy_mix(wy_read8(p + 16) ^ wy_secret[2], wy_read8(p + 24) ^ see1);
+        see2 = wy_mix(wy_read8(p + 32) ^ wy_secret[3], wy_read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wy_mix(wy_read8(p) ^ wy_secret[1], wy_read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wy_read8(p + i - 16);
+    b = wy_read8(p + i - 8);
   }
+
+  a ^= wy_secret[1];
+  b ^= seed;
+  wy_mum(&a, &b);
+  return wy_mix(a ^ wy_secret[0] ^ len, b ^ wy_secret[1]);
 }
 
-// Function handles finding hash_node with a specific key in a linked list
-// of nodes.
-hash_node_t *find_hash_node(hash_node_t *head, char *key) {
-  // Validate parameters and search.
-  if (head && key) {
-    for (hash_node_t *current = head; current; current = current->next) {
-      if (!strcmp(current->key, key)) {
-        // Found it.
-        return current;
-      }
-    }
-    // Didn't find it.
-    return NULL;
-  } else {
-    return NULL;
+/*---- Hash Slot Functions ----*/
+
+// Function handles finding the slot holding a specific key. Robin Hood ordering means we
+// can stop as soon as we're further from home than the slot we're looking at.
+hash_slot_t *find_hash_slot(hash_stripe_t *stripe, char *key, int len, uint64_t hash) {
+  int mask = stripe->size - 1;
+  uint32_t dist = 1;
+
+  for (int i = hash & mask; ; i = (i + 1) & mask, dist++) {
+    hash_slot_t *slot = &stripe->data[i];
+    if (slot->dist < dist) return NULL;
+    if (slot->hash == hash && slot->len == (uint32_t) len && !memcmp(slot_key(slot), key, len)) return slot;
   }
 }
 
-// Function handles removing a hash_node specified by key from a linked
-// list of nodes.
-hash_node_t *remove_hash_node(hash_node_t *head, char *key, void (*destruct) (void *)) {
-  // Validate parameters and search.
-  if (head && key && destruct) {
-    hash_node_t *prev = NULL;
-    for (hash_node_t *current = head; current; current = current->next) {
-      if (!strcmp(current->key, key)) {
-        // Found it.
-        if (prev) {
-          // Normal case.
-          hash_node_t *tmp = current->next;
-          destroy_hash_node(current, destruct);
-          prev->next = tmp;
-          return head;
-        } else {
-          // We need to remove the head.
-          destroy_hash_node(head, destruct);
-          return head->next;
-        }
-      }
-      prev = current;
+// Function handles inserting a slot into a table that's known to have room, and not to
+// contain the key already. Whenever the slot we're carrying is further from home than the
+// one we're looking at, they trade places.
+int insert_hash_slot(hash_slot_t *data, int size, hash_slot_t *insert) {
+  int mask = size - 1;
+  hash_slot_t carry = *insert;
+
+  for (int i = carry.hash & mask; ; i = (i + 1) & mask, carry.dist++) {
+    hash_slot_t *slot = &data[i];
+    if (!slot->dist) {
+      *slot = carry;
+      return 1;
+    } else if (slot->dist < carry.dist) {
+      hash_slot_t tmp = *slot;
+      *slot = carry;
+      carry = tmp;
     }
   }
-  return head;
 }
 
-// Function handles the destruction of an entire linked list of hash_nodes.
-void destroy_hash_chain(hash_node_t *head, void (*destruct) (void *)) {
-  // Iterate across list and destroy each node we come to.
-  while (head) {
-    hash_node_t *tmp = head;
-    head = head->next;
-    destroy_hash_node(tmp, destruct);
+// Function empties the slot at pos. Everything after it that isn't already where it wants
+// to be gets shifted back by one, so lookups never need tombstones.
+void remove_hash_slot(hash_stripe_t *stripe, int pos) {
+  int mask = stripe->size - 1, next = (pos + 1) & mask;
+  while (stripe->data[next].dist > 1) {
+    stripe->data[pos] = stripe->data[next];
+    stripe->data[pos].dist--;
+    pos = next;
+    next = (next + 1) & mask;
   }
+  stripe->data[pos].dist = 0;
+  stripe->count--;
 }
 
-// Function handles the destruction of a specific hash_node struct.
-void destroy_hash_node(hash_node_t *node, void (*destruct) (void *)) {
-  free(node->key);
-  destruct(node->data);
-  free(node);
+// Function returns wherever the key for a slot actually lives.
+char *slot_key(hash_slot_t *slot) {
+  return slot->len < HASH_INLINE_KEY ? slot->inline_key : slot->key;
 }
@@ -3,11 +3,14 @@
 
 /*----- System Includes -----*/
 
+#include <stdint.h>
 #include <pthread.h>
 
 /*----- Numerical Constants -----*/
 
-#define HASH_START_SIZE 10
+#define HASH_START_SIZE 16
+#define HASH_INLINE_KEY 16
+#define HASH_MAX_STRIPES 1024
 #define HASH_SUCCESS 0x0
 #define HASH_FROZEN -0x01
 #define HASH_NOMEM -0x02
@@ -17,25 +20,40 @@
 
 /*----- Struct Declarations -----*/
 
-typedef struct hash_node hash_node_t;
+typedef struct hash_slot hash_slot_t;
 
-// Struct represents a basic hashtable.
+// Struct represents one independently locked piece of a hashtable. Collisions are resolved
+// with Robin Hood open addressing, so each stripe is a single array of slots.
+typedef struct hash_stripe {
+  hash_slot_t *data;
+  int count, size;
+  pthread_rwlock_t lock;
+} hash_stripe_t;
+
+// Struct represents a basic hashtable. Keys are spread across the stripes by their hash, so
+// a write, or a rehash, only ever blocks readers of the one stripe it lands in. A table
+// created with create_hash/init_hash has a single stripe and behaves like a plain rwlocked
+// table.
 typedef struct hash {
-  hash_node_t **data;
+  hash_stripe_t *stripes;
   void (*destruct) (void *);
-  int count, size, dynamic, frozen;
-  pthread_rwlock_t lock;
+  int count, num_stripes, dynamic, frozen;
 } hash_t;
 
 /*----- Hash Functions -----*/
 
 hash_t *create_hash(void (*destruct) (void *));
 int init_hash(hash_t *table, void (*destruct) (void *));
+hash_t *create_striped_hash(void (*destruct) (void *), int num_stripes);
+int init_striped_hash(hash_t *table, void (*destruct) (void *), int num_stripes);
 int hash_put(hash_t *table, char *key, void *data);
 void *hash_get(hash_t *table, char *key);
 int hash_drop(hash_t *table, char *key);
 char **hash_keys(hash_t *table);
+int hash_foreach(hash_t *table, int (*visit) (char *, void *, void *), void *arg);
+int hash_drain(hash_t *table, int (*matches) (char *, void *, void *), void *arg);
 void hash_freeze(hash_t *table);
 void destroy_hash(hash_t *table);
+uint64_t hash_bytes(const char *key, int len);
 
 #endif
@@ -0,0 +1,120 @@
+/*----- System Includes -----*/
+
+#include <stdlib.h>
+#include <string.h>
+
+/*----- Local Includes -----*/
+
+#include "histogram.h"
+
+/*----- Internal Function Declarations -----*/
+
+int bucket_for(uint64_t value);
+uint64_t bucket_ceiling(int bucket);
+
+/*----- Histogram Functions -----*/
+
+void setup_histogram(histogram_t *hist) {
+  memset(hist->counts, 0, sizeof(hist->counts));
+  hist->total = 0;
+  hist->sum = 0;
+  hist->max = 0;
+}
+
+// Function is responsible for creating a histogram struct.
+histogram_t *create_histogram() {
+  histogram_t *hist = malloc(sizeof(histogram_t));
+
+  if (hist) {
+    hist->dynamic = 1;
+    setup_histogram(hist);
+  }
+
+  return hist;
+}
+
+int init_histogram(histogram_t *hist) {
+  if (hist) {
+    hist->dynamic = 0;
+    setup_histogram(hist);
+    return HISTOGRAM_SUCCESS;
+  }
+  return HISTOGRAM_INVAL;
+}
+
+void histogram_record(histogram_t *hist, uint64_t value) {
+  if (!hist) return;
+
+  __atomic_add_fetch(&hist->counts[bucket_for(value)], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&hist->sum, value, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&hist->total, 1, __ATOMIC_RELAXED);
+
+  // Only bother with the compare and swap if we might actually be the new max.
+  uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+  while (value > max && !__atomic_compare_exchange_n(&hist->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// Function returns the smallest value that at least percentile percent of recorded values
+// are at or below, rounded up to the top of its bucket, and never more than the max.
+uint64_t histogram_percentile(histogram_t *hist, double percentile) {
+  uint64_t total = histogram_total(hist), seen = 0;
+  if (!total) return 0;
+
+  uint64_t wanted = (uint64_t) (total * percentile / 100.0 + 0.5);
+  if (wanted < 1) wanted = 1;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += __atomic_load_n(&hist->counts[i], __ATOMIC_RELAXED);
+    if (seen >= wanted) {
+      uint64_t ceiling = bucket_ceiling(i), max = histogram_max(hist);
+      return ceiling < max ? ceiling : max;
+    }
+  }
+  return histogram_max(hist);
+}
+
+uint64_t histogram_total(histogram_t *hist) {
+  return hist ? __atomic_load_n(&hist->total, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t histogram_max(histogram_t *hist) {
+  return hist ? __atomic_load_n(&hist->max, __ATOMIC_RELAXED) : 0;
+}
+
+uint64_t histogram_mean(histogram_t *hist) {
+  uint64_t total = histogram_total(hist);
+  return total ? __atomic_load_n(&hist->sum, __ATOMIC_RELAXED) / total : 0;
+}
+
+// Function empties a histogram out so it can be used again. Not safe while anyone else is
+// recording.
+void histogram_clear(histogram_t *hist) {
+  if (hist) setup_histogram(hist);
+}
+
+void destroy_histogram(histogram_t *hist) {
+  if (hist && hist->dynamic) free(hist);
+}
+
+/*----- Internal Functions -----*/
+
+// Function maps a value to its bucket. Values below HISTOGRAM_SUB_BUCKETS get a bucket each,
+// after that the top HISTOGRAM_SUB_BITS bits below the leading one pick the bucket within
+// each power of two.
+int bucket_for(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) return value;
+
+  int exponent = 63 - __builtin_clzll(value);
+  if (exponent >= HISTOGRAM_MAX_BITS) return HISTOGRAM_BUCKETS - 1;
+  int sub = (value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// Function returns the largest value that maps to a bucket.
+uint64_t bucket_ceiling(int bucket) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+
+  int exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+  uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+  uint64_t floor = (HISTOGRAM_SUB_BUCKETS + sub) << (exponent - HISTOGRAM_SUB_BITS);
+  return floor + (1ull << (exponent - HISTOGRAM_SUB_BITS)) - 1;
+}
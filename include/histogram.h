@@ -0,0 +1,44 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/*----- System Includes -----*/
+
+#include <stdint.h>
+
+/*----- Numerical Constants -----*/
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+#define HISTOGRAM_SUCCESS 0x0
+#define HISTOGRAM_NOMEM -0x01
+#define HISTOGRAM_INVAL -0x02
+
+/*----- Type Declarations -----*/
+
+// Struct represents a log-linear histogram in the style of HdrHistogram. Every power of two
+// is split into HISTOGRAM_SUB_BUCKETS buckets, so any recorded value is known to within
+// 12.5%, and values up to 2^HISTOGRAM_MAX_BITS fit before everything piles into the top
+// bucket. Recording is a couple of atomic adds, so any number of threads can record while
+// any number of others read, without locks. Readers may see a sample that's only partially
+// recorded, which is fine for stats.
+typedef struct histogram {
+  uint32_t counts[HISTOGRAM_BUCKETS];
+  uint64_t total, sum, max;
+  int dynamic;
+} histogram_t;
+
+/*----- Function Declarations -----*/
+
+histogram_t *create_histogram();
+int init_histogram(histogram_t *hist);
+void histogram_record(histogram_t *hist, uint64_t value);
+uint64_t histogram_percentile(histogram_t *hist, double percentile);
+uint64_t histogram_total(histogram_t *hist);
+uint64_t histogram_max(histogram_t *hist);
+uint64_t histogram_mean(histogram_t *hist);
+void histogram_clear(histogram_t *hist);
+void destroy_histogram(histogram_t *hist);
+
+#endif
@@ -9,19 +9,22 @@
 
 /*----- Type Declarations -----*/
 
+// Data is stored right behind the links, so each node is a single slab object. owner, if
+// set, is the producer's handle on its newest node, which has to be cleared when it goes.
 struct list_node {
-  void *data;
-  struct list_node *next, *prev;
+  struct list_node *next, *prev, **owner;
+  slab_align_t data[];
 };
 
 /*----- Internal Function Declarations -----*/
 
-list_node_t *create_list_node(void *data, int elem_len);
-void destroy_list_node(list_node_t *node, void (*destruct) (void *));
+list_node_t *create_list_node(list_t *lst, void *data);
+void destroy_list_node(list_t *lst, list_node_t *node);
 
 /*----- List Functions -----*/
 
 int setup_list(list_t *lst, int elem_len, void (*destruct) (void *)) {
+  if (elem_len <= 0 || init_slab(&lst->nodes, sizeof(list_node_t) + elem_len, SLAB_DEFAULT_LEN)) return 0;
   int retval = pthread_mutex_init(&lst->mutex, NULL);
   if (!retval) {
     lst->head = NULL;
@@ -29,7 +32,10 @@ int setup_list(list_t *lst, int elem_len, void (*destruct) (void *)) {
     lst->count = 0;
     lst->frozen = 0;
     lst->elem_len = elem_len;
+    lst->max = 0;
+    lst->policy = LIST_DROP_OLDEST;
     lst->destruct = destruct;
+    lst->mergeable = NULL;
     return 1;
   }
   return 0;
@@ -59,13 +65,73 @@ int init_list(list_t *lst, int elem_len, void (*destruct) (void *)) {
   return LIST_INVAL;
 }
 
+// Function caps the number of elements a list will hold. A max of zero means unbounded.
+// mergeable is only used by LIST_COALESCE, and should return false for elements that must
+// never be overwritten. If it isn't given, every element can be.
+int list_bound(list_t *lst, int max, list_policy_t policy, int (*mergeable) (void *)) {
+  if (!lst || max < 0) return LIST_INVAL;
+
+  pthread_mutex_lock(&lst->mutex);
+  lst->max = max;
+  lst->policy = policy;
+  lst->mergeable = mergeable;
+  pthread_mutex_unlock(&lst->mutex);
+  return LIST_SUCCESS;
+}
+
 int lpush(list_t *lst, void *data) {
+  return lpush_evict(lst, data, NULL);
+}
+
+int lpush_evict(list_t *lst, void *data, void *evicted) {
+  return lpush_from(lst, data, evicted, NULL);
+}
+
+// Function pushes data onto the list, applying the list's policy if it's at its bound.
+// Returns LIST_EVICTED if an older element had to make room, in which case it's copied
+// into evicted if given, or LIST_FULL if data itself was thrown away.
+// newest, if given, is the producer's handle on its newest element still in the list, and
+// must start out NULL. It's what LIST_COALESCE overwrites, so coalescing never has to search
+// the list. The list keeps it up to date, under its mutex, until list_disown.
+int lpush_from(list_t *lst, void *data, void *evicted, list_node_t **newest) {
   // Validate given parameters.
   if (!lst || !data) return LIST_INVAL;
 
-  list_node_t *node = create_list_node(data, lst->elem_len);
+  // Nodes come out of the list's slab, which is protected by the list's mutex.
+  pthread_mutex_lock(&lst->mutex);
+  int mergeable = newest && (!lst->mergeable || lst->mergeable(data));
+  if (lst->max && lst->count >= lst->max && lst->policy == LIST_COALESCE && mergeable && *newest) {
+    // Replace the producer's newest element in place, so it keeps its spot in line. Only
+    // mergeable elements are ever handed out, so there's nothing to check.
+    list_node_t *current = *newest;
+    if (evicted) memcpy(evicted, current->data, lst->elem_len);
+    memcpy(current->data, data, lst->elem_len);
+    pthread_mutex_unlock(&lst->mutex);
+    return LIST_EVICTED;
+  }
+
+  list_node_t *node = create_list_node(lst, data);
   if (node) {
-    pthread_mutex_lock(&lst->mutex);
+    int retval = LIST_SUCCESS;
+
+    if (lst->max && lst->count >= lst->max) {
+      if (lst->policy == LIST_DROP_NEWEST) {
+        destroy_list_node(lst, node);
+        pthread_mutex_unlock(&lst->mutex);
+        return LIST_FULL;
+      }
+
+      // Either dropping the oldest, or there was nothing to coalesce with. Either way,
+      // make room at the tail.
+      list_node_t *oldest = lst->tail;
+      lst->tail = oldest->prev;
+      if (lst->tail) lst->tail->next = NULL;
+      else lst->head = NULL;
+      lst->count--;
+      if (evicted) memcpy(evicted, oldest->data, lst->elem_len);
+      destroy_list_node(lst, oldest);
+      retval = LIST_EVICTED;
+    }
 
     // Push data into list at head and increment count.
     if (lst->head) {
@@ -78,13 +144,63 @@ int lpush(list_t *lst, void *data) {
     }
     lst->count++;
 
+    // Whatever the producer had queued before is no longer its newest. Anything that can't
+    // be overwritten leaves it with nothing to coalesce into, rather than something queued
+    // ahead of it.
+    if (newest) {
+      if (*newest) (*newest)->owner = NULL;
+      *newest = mergeable ? node : NULL;
+      node->owner = *newest ? newest : NULL;
+    }
+
     pthread_mutex_unlock(&lst->mutex);
-    return LIST_SUCCESS;
+    return retval;
   }
 
+  pthread_mutex_unlock(&lst->mutex);
   return LIST_NOMEM;
 }
 
+// Function lets go of a producer's handle, for a producer that's going away while its
+// elements are still in the list. They stay queued, but can't be coalesced into anymore.
+void list_disown(list_t *lst, list_node_t **newest) {
+  if (!lst || !newest) return;
+
+  pthread_mutex_lock(&lst->mutex);
+  if (*newest) (*newest)->owner = NULL;
+  *newest = NULL;
+  pthread_mutex_unlock(&lst->mutex);
+}
+
+// Function puts data back at the tail, where rpop takes from, for a consumer that popped
+// something it couldn't deal with yet. The list's bound doesn't apply, as the consumer is
+// only handing back room it took.
+int rpush(list_t *lst, void *data) {
+  // Validate given parameters.
+  if (!lst || !data) return LIST_INVAL;
+
+  pthread_mutex_lock(&lst->mutex);
+  list_node_t *node = create_list_node(lst, data);
+  if (!node) {
+    pthread_mutex_unlock(&lst->mutex);
+    return LIST_NOMEM;
+  }
+
+  // Push data into list at tail and increment count.
+  if (lst->tail) {
+    node->prev = lst->tail;
+    lst->tail->next = node;
+    lst->tail = node;
+  } else {
+    lst->head = node;
+    lst->tail = node;
+  }
+  lst->count++;
+
+  pthread_mutex_unlock(&lst->mutex);
+  return LIST_SUCCESS;
+}
+
 int rpop(list_t *lst, void *buf) {
   // Validate given parameters.
   if (!lst || !buf) return LIST_INVAL;
@@ -103,11 +219,11 @@ int rpop(list_t *lst, void *buf) {
   }
   lst->count--;
 
-  pthread_mutex_unlock(&lst->mutex);
-
-  // Isolate the data, destroy the node, and return.
+  // Isolate the data, give the node back, and return.
   memcpy(buf, node->data, lst->elem_len);
-  destroy_list_node(node, lst->destruct);
+  destroy_list_node(lst, node);
+
+  pthread_mutex_unlock(&lst->mutex);
   return LIST_SUCCESS;
 }
 
@@ -121,11 +237,12 @@ void destroy_list(list_t *lst) {
     while (current) {
       list_node_t *tmp = current;
       current = current->next;
-      destroy_list_node(tmp, lst->destruct);
+      destroy_list_node(lst, tmp);
     }
   }
 
-  // Release the list's mutex.
+  // Release the list's nodes and mutex.
+  destroy_slab(&lst->nodes);
   pthread_mutex_destroy(&lst->mutex);
 
   // Free list if necessary.
@@ -134,28 +251,25 @@ void destroy_list(list_t *lst) {
 
 /*----- List Node Functions -----*/
 
-// Function is responsible for creating a list node struct.
-list_node_t *create_list_node(void *data, int elem_len) {
-  list_node_t *node = malloc(sizeof(list_node_t));
-  void *data_cpy = malloc(elem_len);
+// Function is responsible for creating a list node struct. Must be called with the list's
+// mutex held.
+list_node_t *create_list_node(list_t *lst, void *data) {
+  list_node_t *node = slab_alloc(&lst->nodes);
 
-  if (node && data_cpy) {
-    node->data = data_cpy;
-    memcpy(node->data, data, elem_len);
+  if (node) {
+    memcpy(node->data, data, lst->elem_len);
     node->next = NULL;
     node->prev = NULL;
-  } else if (!data_cpy) {
-    free(node);
-    node = NULL;
-  } else {
-    free(data_cpy);
+    node->owner = NULL;
   }
 
   return node;
 }
 
-// Function is responsible for destroying a list node.
-void destroy_list_node(list_node_t *node, void (*destruct) (void *)) {
-  destruct(node->data);
-  free(node);
+// Function is responsible for destroying a list node. Must be called with the list's mutex
+// held.
+void destroy_list_node(list_t *lst, list_node_t *node) {
+  if (node->owner) *node->owner = NULL;
+  if (lst->destruct) lst->destruct(node->data);
+  slab_free(&lst->nodes, node);
 }
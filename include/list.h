@@ -5,6 +5,10 @@
 
 #include <pthread.h>
 
+/*----- Local Includes -----*/
+
+#include "slab.h"
+
 /*----- Numerical Constants -----*/
 
 #define LIST_SUCCESS 0x0
@@ -12,25 +16,45 @@
 #define LIST_NOMEM -0x02
 #define LIST_INVAL -0x04
 #define LIST_EMPTY -0x08
+#define LIST_FULL -0x10
+#define LIST_EVICTED 0x1
 
 /*----- Type Declarations -----*/
 
 // List node forward declaration.
 typedef struct list_node list_node_t;
 
-// Struct represents a threadsafe list.
+// Decides what happens when pushing onto a list that has reached its bound.
+typedef enum {
+  LIST_DROP_OLDEST,
+  LIST_DROP_NEWEST,
+  LIST_COALESCE
+} list_policy_t;
+
+// Struct represents a threadsafe list. Elements are copied into nodes drawn from the list's
+// own slab, so a list that has reached its working size never calls malloc. destruct, if
+// given, is called on an element before its node is reused, and must not free it.
+// mergeable, if given, says which elements LIST_COALESCE is allowed to overwrite.
 typedef struct list {
   list_node_t *head, *tail;
-  int count, dynamic, frozen, elem_len;
+  int count, dynamic, frozen, elem_len, max;
+  list_policy_t policy;
+  slab_t nodes;
   pthread_mutex_t mutex;
   void (*destruct) (void *);
+  int (*mergeable) (void *);
 } list_t;
 
 /*----- Function Declarations -----*/
 
 list_t *create_list(int elem_len, void (*destruct) (void *));
 int init_list(list_t *lst, int elem_len, void (*destruct) (void *));
+int list_bound(list_t *lst, int max, list_policy_t policy, int (*mergeable) (void *));
 int lpush(list_t *lst, void *data);
+int lpush_evict(list_t *lst, void *data, void *evicted);
+int lpush_from(list_t *lst, void *data, void *evicted, list_node_t **newest);
+void list_disown(list_t *lst, list_node_t **newest);
+int rpush(list_t *lst, void *data);
 int rpop(list_t *lst, void *buf);
 void destroy_list(list_t *lst);
 
@@ -0,0 +1,455 @@
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+/*----- Local Includes -----*/
+
+#include "logger.h"
+
+/*----- Type Declarations -----*/
+
+// Every record starts with one of these, followed by the message's arguments in the order
+// they appear in fmt. Records are padded out to a multiple of 8 bytes.
+typedef struct logger_header {
+  uint32_t len;
+  int priority;
+  const char *fmt;
+} logger_header_t;
+
+// Struct describes a single conversion in a format string, from the % to the conversion
+// character.
+typedef struct logger_spec {
+  const char *start, *end;
+  int star_width, star_prec;
+  char length[3];
+} logger_spec_t;
+
+/*----- Internal Function Declarations -----*/
+
+logger_ring_t *claim_logger_ring();
+void create_logger_key();
+void release_logger_ring(void *voidring);
+void *run_logger(void *unused);
+void drain_logger_rings();
+void write_direct(int priority, const char *fmt, va_list args);
+void default_sink(int priority, char *message);
+const char *parse_spec(const char *c, logger_spec_t *spec);
+int encode_args(char *buf, int len, const char *fmt, va_list args);
+void format_record(logger_header_t *header, char *record, char *message);
+int format_arg(char *out, int len, logger_spec_t *spec, char *record, int record_len, int *offset);
+void ring_copy_in(logger_ring_t *ring, uint64_t pos, char *data, int len);
+void ring_copy_out(logger_ring_t *ring, uint64_t pos, char *data, int len);
+
+/*----- Evil but Necessary Globals -----*/
+
+int logger_level = 7;
+
+// Logging is per process, so the rings have to live somewhere everyone can find them.
+// Rings are never freed, so a thread that's still logging while the process exits can't
+// end up writing into freed memory. They stay reachable from here until then.
+static logger_ring_t *rings[LOGGER_MAX_RINGS];
+static int num_rings = 0, running = 0, stopping = 0;
+static long dropped = 0;
+static __thread logger_ring_t *own_ring = NULL;
+static logger_sink_t logger_sink = default_sink;
+static pthread_t logger_thread;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+/*----- Logger Functions -----*/
+
+// Function starts the logging thread. Until it's called, and after destroy_logger, messages
+// are formatted and handed to the sink on the spot.
+int init_logger(int level, logger_sink_t sink) {
+  if (!sink) return LOGGER_INVAL;
+
+  logger_set_level(level);
+  logger_sink = sink;
+  stopping = 0;
+
+  // The logging thread shouldn't ever be the one a signal gets delivered to, so it starts
+  // out with everything blocked.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int retval = pthread_create(&logger_thread, NULL, run_logger, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (retval) return LOGGER_NOMEM;
+  __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+  return LOGGER_SUCCESS;
+}
+
+// Function queues a message for the logging thread. Nothing is formatted here, the arguments
+// are just copied into the calling thread's ring, strings included, so fmt has to be a string
+// literal. If the ring is full the message is dropped rather than waiting for room. Threads
+// that couldn't get a ring pay for formatting and writing their messages themselves.
+void logger_write(int priority, const char *fmt, ...) {
+  char record[LOGGER_MAX_RECORD];
+  va_list args;
+  va_start(args, fmt);
+
+  logger_ring_t *ring = NULL;
+  if (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) ring = own_ring ? own_ring : claim_logger_ring();
+  if (!ring) {
+    write_direct(priority, fmt, args);
+    va_end(args);
+    return;
+  }
+
+  logger_header_t header;
+  int len = sizeof(logger_header_t);
+  len += encode_args(record + len, LOGGER_MAX_RECORD - len, fmt, args);
+  va_end(args);
+  header.len = (len + 7) & ~7;
+  header.priority = priority;
+  header.fmt = fmt;
+  memcpy(record, &header, sizeof(logger_header_t));
+
+  uint64_t head = ring->head, tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (head - tail + header.len > LOGGER_RING_SIZE) {
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  ring_copy_in(ring, head, record, header.len);
+  __atomic_store_n(&ring->head, head + header.len, __ATOMIC_RELEASE);
+}
+
+void logger_set_level(int level) {
+  __atomic_store_n(&logger_level, level, __ATOMIC_RELAXED);
+}
+
+long logger_dropped() {
+  return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+// Function stops the logging thread, once it's written out everything that was queued.
+void destroy_logger() {
+  if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+  __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&wake_mutex);
+  stopping = 1;
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&wake_mutex);
+  pthread_join(logger_thread, NULL);
+}
+
+/*----- Internal Functions -----*/
+
+// Function gives the calling thread a ring, reusing one left behind by a thread that's gone
+// if it can, and making a new one otherwise. Returns NULL once we're out of rings, so the
+// thread keeps asking, and picks one up once another thread exits.
+logger_ring_t *claim_logger_ring() {
+  logger_ring_t *ring = NULL;
+  pthread_once(&ring_once, create_logger_key);
+
+  int count = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+  if (count > LOGGER_MAX_RINGS) count = LOGGER_MAX_RINGS;
+  for (int i = 0; i < count && !ring; i++) {
+    logger_ring_t *candidate = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+    int unowned = 0;
+    if (candidate && __atomic_compare_exchange_n(&candidate->owned, &unowned, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      ring = candidate;
+    }
+  }
+
+  if (!ring) {
+    if (count >= LOGGER_MAX_RINGS) return NULL;
+    int index = __atomic_fetch_add(&num_rings, 1, __ATOMIC_ACQ_REL);
+    if (index >= LOGGER_MAX_RINGS || !(ring = calloc(1, sizeof(logger_ring_t)))) return NULL;
+    ring->owned = 1;
+    __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+  }
+
+  pthread_setspecific(ring_key, ring);
+  own_ring = ring;
+  return ring;
+}
+
+void create_logger_key() {
+  pthread_key_create(&ring_key, release_logger_ring);
+}
+
+// Function hands a ring back when its thread exits. Anything still in it gets written out
+// as usual.
+void release_logger_ring(void *voidring) {
+  logger_ring_t *ring = voidring;
+  __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+// Function is the logging thread. Wakes up every LOGGER_FLUSH_MS milliseconds and writes out
+// whatever has been queued since, and once more on the way out.
+void *run_logger(void *unused) {
+  (void) unused;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&wake_mutex);
+  while (!stopping) {
+    pthread_mutex_unlock(&wake_mutex);
+    drain_logger_rings();
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LOGGER_FLUSH_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&wake_mutex);
+    if (!stopping) pthread_cond_timedwait(&wake, &wake_mutex, &deadline);
+  }
+  pthread_mutex_unlock(&wake_mutex);
+  drain_logger_rings();
+  return NULL;
+}
+
+// Function formats and writes out every record in every ring. Messages from any one thread
+// come out in order, but threads aren't interleaved by time.
+void drain_logger_rings() {
+  char record[LOGGER_MAX_RECORD], message[LOGGER_MAX_MESSAGE];
+  logger_header_t header;
+
+  int count = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+  if (count > LOGGER_MAX_RINGS) count = LOGGER_MAX_RINGS;
+  for (int i = 0; i < count; i++) {
+    logger_ring_t *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+    if (!ring) continue;
+
+    uint64_t tail = ring->tail, head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    while (tail < head) {
+      ring_copy_out(ring, tail, (char *) &header, sizeof(logger_header_t));
+      ring_copy_out(ring, tail, record, header.len);
+      format_record(&header, record, message);
+      pthread_mutex_lock(&sink_mutex);
+      logger_sink(header.priority, message);
+      pthread_mutex_unlock(&sink_mutex);
+      tail += header.len;
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// Function formats a message on the spot and hands it to the sink, for when there's no
+// logging thread, or no ring to queue it on. Messages from threads without rings can't be
+// kept in order with anything queued before them, but there's never more than one thread
+// in the sink at a time.
+void write_direct(int priority, const char *fmt, va_list args) {
+  char message[LOGGER_MAX_MESSAGE];
+  vsnprintf(message, LOGGER_MAX_MESSAGE, fmt, args);
+  pthread_mutex_lock(&sink_mutex);
+  logger_sink(priority, message);
+  pthread_mutex_unlock(&sink_mutex);
+}
+
+void default_sink(int priority, char *message) {
+  (void) priority;
+  fputs(message, stderr);
+}
+
+// Function fills in spec for the conversion starting at c, which has to point at a %.
+// Returns a pointer to the conversion character, or to the terminator if there isn't one.
+const char *parse_spec(const char *c, logger_spec_t *spec) {
+  memset(spec, 0, sizeof(logger_spec_t));
+  spec->start = c++;
+
+  while (*c && strchr("-+ #0'", *c)) c++;
+  if (*c == '*') {
+    spec->star_width = 1;
+    c++;
+  }
+  while (*c >= '0' && *c <= '9') c++;
+  if (*c == '.') {
+    c++;
+    if (*c == '*') {
+      spec->star_prec = 1;
+      c++;
+    }
+    while (*c >= '0' && *c <= '9') c++;
+  }
+  for (int i = 0; i < 2 && *c && strchr("hlLqjzt", *c); i++) spec->length[i] = *c++;
+
+  spec->end = c;
+  return c;
+}
+
+// Function copies the arguments for every conversion in fmt into buf. Integers are widened
+// to 8 bytes, strings are copied in, truncated if they don't fit. Returns the number of bytes
+// used.
+int encode_args(char *buf, int len, const char *fmt, va_list args) {
+  int offset = 0;
+  logger_spec_t spec;
+
+  for (const char *c = fmt; *c; c++) {
+    if (*c != '%') continue;
+    c = parse_spec(c, &spec);
+    if (!*c) break;
+    if (*c == '%') continue;
+
+    // Stars come before the argument they apply to.
+    int stars[2] = {spec.star_width, spec.star_prec};
+    for (int i = 0; i < 2; i++) {
+      if (!stars[i]) continue;
+      int64_t star = va_arg(args, int);
+      if (offset + 8 > len) return offset;
+      memcpy(buf + offset, &star, 8);
+      offset += 8;
+    }
+
+    char *l = spec.length;
+    if (strchr("diouxXc", *c)) {
+      int64_t value;
+      int is_signed = *c == 'd' || *c == 'i';
+      if (!strcmp(l, "l")) value = is_signed ? va_arg(args, long) : (int64_t) va_arg(args, unsigned long);
+      else if (!strcmp(l, "ll") || !strcmp(l, "q")) value = is_signed ? va_arg(args, long long) : (int64_t) va_arg(args, unsigned long long);
+      else if (!strcmp(l, "z")) value = va_arg(args, size_t);
+      else if (!strcmp(l, "j")) value = va_arg(args, intmax_t);
+      else if (!strcmp(l, "t")) value = va_arg(args, ptrdiff_t);
+      else value = is_signed ? va_arg(args, int) : (int64_t) va_arg(args, unsigned int);
+      if (offset + 8 > len) return offset;
+      memcpy(buf + offset, &value, 8);
+      offset += 8;
+    } else if (strchr("fFeEgGaA", *c)) {
+      if (!strcmp(l, "L")) {
+        long double value = va_arg(args, long double);
+        if (offset + (int) sizeof(long double) > len) return offset;
+        memcpy(buf + offset, &value, sizeof(long double));
+        offset += sizeof(long double);
+      } else {
+        double value = va_arg(args, double);
+        if (offset + 8 > len) return offset;
+        memcpy(buf + offset, &value, 8);
+        offset += 8;
+      }
+    } else if (*c == 's') {
+      char *str = va_arg(args, char *);
+      if (!str) str = "(null)";
+      if (offset + 2 > len) return offset;
+      uint16_t str_len = strnlen(str, len - offset - 2);
+      memcpy(buf + offset, &str_len, 2);
+      memcpy(buf + offset + 2, str, str_len);
+      offset += 2 + str_len;
+    } else if (*c == 'p') {
+      void *value = va_arg(args, void *);
+      if (offset + 8 > len) return offset;
+      memcpy(buf + offset, &value, sizeof(void *));
+      offset += 8;
+    } else {
+      // Anything we don't understand, %n included, ends the message there.
+      break;
+    }
+  }
+  return offset;
+}
+
+// Function turns a record back into the message it was logged as.
+void format_record(logger_header_t *header, char *record, char *message) {
+  int offset = sizeof(logger_header_t), out = 0;
+  logger_spec_t spec;
+
+  for (const char *c = header->fmt; *c && out < LOGGER_MAX_MESSAGE - 1; c++) {
+    if (*c != '%') {
+      message[out++] = *c;
+      continue;
+    }
+    c = parse_spec(c, &spec);
+    if (!*c) break;
+    if (*c == '%') {
+      message[out++] = '%';
+      continue;
+    }
+
+    int written = format_arg(message + out, LOGGER_MAX_MESSAGE - out, &spec, record, header->len, &offset);
+    if (written < 0) break;
+    out += written;
+    if (out > LOGGER_MAX_MESSAGE - 1) out = LOGGER_MAX_MESSAGE - 1;
+  }
+  message[out] = '\0';
+}
+
+// Function formats the argument for a single conversion, reading it out of the record at
+// offset. Returns what snprintf does, or -1 if the argument never made it into the record.
+int format_arg(char *out, int len, logger_spec_t *spec, char *record, int record_len, int *offset) {
+  char fmt[LOGGER_MAX_SPEC];
+  int used = 0, stars[2] = {spec->star_width, spec->star_prec};
+
+  // Stars get replaced with the values that were passed for them.
+  int64_t star_values[2];
+  for (int i = 0; i < 2; i++) {
+    if (!stars[i]) continue;
+    if (*offset + 8 > record_len) return -1;
+    memcpy(&star_values[i], record + *offset, 8);
+    *offset += 8;
+  }
+  for (const char *c = spec->start; c <= spec->end && used < LOGGER_MAX_SPEC - 12; c++) {
+    if (*c != '*') fmt[used++] = *c;
+    else used += sprintf(fmt + used, "%d", (int) star_values[c > spec->start && c[-1] == '.']);
+  }
+  fmt[used] = '\0';
+
+  char conv = *spec->end, *l = spec->length;
+  if (strchr("diouxXc", conv)) {
+    int64_t value;
+    if (*offset + 8 > record_len) return -1;
+    memcpy(&value, record + *offset, 8);
+    *offset += 8;
+    int is_signed = conv == 'd' || conv == 'i';
+    if (!strcmp(l, "l")) return is_signed ? snprintf(out, len, fmt, (long) value) : snprintf(out, len, fmt, (unsigned long) value);
+    if (!strcmp(l, "ll") || !strcmp(l, "q")) return is_signed ? snprintf(out, len, fmt, (long long) value) : snprintf(out, len, fmt, (unsigned long long) value);
+    if (!strcmp(l, "z")) return snprintf(out, len, fmt, (size_t) value);
+    if (!strcmp(l, "j")) return snprintf(out, len, fmt, (intmax_t) value);
+    if (!strcmp(l, "t")) return snprintf(out, len, fmt, (ptrdiff_t) value);
+    return is_signed ? snprintf(out, len, fmt, (int) value) : snprintf(out, len, fmt, (unsigned int) value);
+  } else if (strchr("fFeEgGaA", conv)) {
+    if (!strcmp(l, "L")) {
+      long double value;
+      if (*offset + (int) sizeof(long double) > record_len) return -1;
+      memcpy(&value, record + *offset, sizeof(long double));
+      *offset += sizeof(long double);
+      return snprintf(out, len, fmt, value);
+    }
+    double value;
+    if (*offset + 8 > record_len) return -1;
+    memcpy(&value, record + *offset, 8);
+    *offset += 8;
+    return snprintf(out, len, fmt, value);
+  } else if (conv == 's') {
+    uint16_t str_len;
+    char str[LOGGER_MAX_RECORD];
+    if (*offset + 2 > record_len) return -1;
+    memcpy(&str_len, record + *offset, 2);
+    memcpy(str, record + *offset + 2, str_len);
+    str[str_len] = '\0';
+    *offset += 2 + str_len;
+    return snprintf(out, len, fmt, str);
+  } else if (conv == 'p') {
+    void *value;
+    if (*offset + 8 > record_len) return -1;
+    memcpy(&value, record + *offset, sizeof(void *));
+    *offset += 8;
+    return snprintf(out, len, fmt, value);
+  }
+  return -1;
+}
+
+// Functions copy bytes in and out of a ring, wrapping around the end as necessary.
+void ring_copy_in(logger_ring_t *ring, uint64_t pos, char *data, int len) {
+  int start = pos % LOGGER_RING_SIZE, first = LOGGER_RING_SIZE - start;
+  if (first > len) first = len;
+  memcpy(ring->data + start, data, first);
+  memcpy(ring->data, data + first, len - first);
+}
+
+void ring_copy_out(logger_ring_t *ring, uint64_t pos, char *data, int len) {
+  int start = pos % LOGGER_RING_SIZE, first = LOGGER_RING_SIZE - start;
+  if (first > len) first = len;
+  memcpy(data, ring->data + start, first);
+  memcpy(data + first, ring->data, len - first);
+}
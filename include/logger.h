@@ -0,0 +1,51 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+/*----- System Includes -----*/
+
+#include <stdint.h>
+
+/*----- Numerical Constants -----*/
+
+#define LOGGER_RING_SIZE (1 << 14)
+#define LOGGER_MAX_RINGS 256
+#define LOGGER_MAX_RECORD 1024
+#define LOGGER_MAX_MESSAGE 1024
+#define LOGGER_MAX_SPEC 32
+#define LOGGER_FLUSH_MS 50
+#define LOGGER_SUCCESS 0x0
+#define LOGGER_NOMEM -0x01
+#define LOGGER_INVAL -0x02
+#define LOGGER_FULL -0x04
+
+/*----- Type Declarations -----*/
+
+// Decides where formatted messages end up. Only ever called from one thread at a time.
+typedef void (*logger_sink_t) (int priority, char *message);
+
+// Struct represents one thread's queue of unformatted messages. The owning thread writes
+// records in at head, the logging thread formats them and moves tail up behind it, so
+// neither ever waits on the other. Rings outlive their threads, and get picked up again
+// by the next thread to start. Threads that can't get one format their own messages and
+// hand them to the sink directly.
+typedef struct logger_ring {
+  char data[LOGGER_RING_SIZE];
+  uint64_t head, tail;
+  int owned;
+} logger_ring_t;
+
+/*----- Evil but Necessary Globals -----*/
+
+// Messages with a priority above this aren't logged. Read on every call to write_log,
+// so it lives out here where the check can be inlined.
+extern int logger_level;
+
+/*----- Function Declarations -----*/
+
+int init_logger(int level, logger_sink_t sink);
+void logger_write(int priority, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+void logger_set_level(int level);
+long logger_dropped();
+void destroy_logger();
+
+#endif
@@ -0,0 +1,105 @@
+/*----- System Includes -----*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*----- Local Includes -----*/
+
+#include "outbuf.h"
+
+/*----- Outbuf Functions -----*/
+
+int setup_outbuf(outbuf_t *ob, int size) {
+  if (size <= 0) return OUTBUF_INVAL;
+
+  ob->data = malloc(size);
+  if (!ob->data) return OUTBUF_NOMEM;
+  ob->size = size;
+  ob->written = 0;
+  outbuf_clear(ob);
+  return OUTBUF_SUCCESS;
+}
+
+// Function is responsible for creating an outbuf struct.
+outbuf_t *create_outbuf(int size) {
+  outbuf_t *ob = malloc(sizeof(outbuf_t));
+
+  if (ob) {
+    ob->dynamic = 1;
+    if (setup_outbuf(ob, size) != OUTBUF_SUCCESS) {
+      free(ob);
+      ob = NULL;
+    }
+  }
+
+  return ob;
+}
+
+int init_outbuf(outbuf_t *ob, int size) {
+  if (ob) {
+    ob->dynamic = 0;
+    return setup_outbuf(ob, size);
+  }
+  return OUTBUF_INVAL;
+}
+
+// Function copies len bytes onto the end of the buffer, sliding pending bytes back to the
+// front, or growing the buffer, if there isn't room at the end.
+int outbuf_append(outbuf_t *ob, char *data, int len) {
+  // Validate given parameters.
+  if (!ob || !data || len < 0) return OUTBUF_INVAL;
+
+  if (ob->start + ob->len + len > ob->size) {
+    memmove(ob->data, ob->data + ob->start, ob->len);
+    ob->start = 0;
+
+    if (ob->len + len > ob->size) {
+      int size = ob->size;
+      while (size < ob->len + len) size *= 2;
+      char *data = realloc(ob->data, size);
+      if (!data) return OUTBUF_NOMEM;
+      ob->data = data;
+      ob->size = size;
+    }
+  }
+
+  memcpy(ob->data + ob->start + ob->len, data, len);
+  ob->len += len;
+  return OUTBUF_SUCCESS;
+}
+
+// Function writes as much as the socket will take without blocking. Partial writes pick up
+// exactly where they left off next time.
+// Returns the number of bytes still pending, or OUTBUF_CLOSED if the socket is dead.
+int outbuf_flush(outbuf_t *ob, int fd) {
+  // Validate given parameters.
+  if (!ob) return OUTBUF_INVAL;
+
+  while (ob->len > 0) {
+    int retval = write(fd, ob->data + ob->start, ob->len);
+    if (retval > 0) {
+      ob->start += retval;
+      ob->len -= retval;
+      ob->written += retval;
+    } else if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else if (retval < 0 && errno != EINTR) {
+      return OUTBUF_CLOSED;
+    }
+  }
+
+  if (!ob->len) ob->start = 0;
+  return ob->len;
+}
+
+void outbuf_clear(outbuf_t *ob) {
+  ob->start = 0;
+  ob->len = 0;
+}
+
+void destroy_outbuf(outbuf_t *ob) {
+  free(ob->data);
+  if (ob->dynamic) free(ob);
+}
@@ -0,0 +1,31 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+/*----- Numerical Constants -----*/
+
+#define OUTBUF_SUCCESS 0x0
+#define OUTBUF_NOMEM -0x01
+#define OUTBUF_INVAL -0x02
+#define OUTBUF_CLOSED -0x04
+
+/*----- Type Declarations -----*/
+
+// Struct represents the bytes waiting to go out on a non-blocking socket. Not threadsafe,
+// belongs to whoever writes the socket. Grows as needed, so it's up to the owner to
+// decide how much is too much. written counts every byte that's ever made it out.
+typedef struct outbuf {
+  char *data;
+  int start, len, size, dynamic;
+  long written;
+} outbuf_t;
+
+/*----- Function Declarations -----*/
+
+outbuf_t *create_outbuf(int size);
+int init_outbuf(outbuf_t *ob, int size);
+int outbuf_append(outbuf_t *ob, char *data, int len);
+int outbuf_flush(outbuf_t *ob, int fd);
+void outbuf_clear(outbuf_t *ob);
+void destroy_outbuf(outbuf_t *ob);
+
+#endif
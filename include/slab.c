@@ -0,0 +1,117 @@
+/*----- System Includes -----*/
+
+#include <stdlib.h>
+#include <stddef.h>
+
+/*----- Local Includes -----*/
+
+#include "slab.h"
+
+/*----- Type Declarations -----*/
+
+// Every slab starts with a pointer to the slab before it, so they can all be found again at
+// destruction time. Free objects store the next free object in their first bytes.
+typedef struct slab_header {
+  struct slab_header *next;
+  slab_align_t align;
+} slab_header_t;
+
+/*----- Internal Function Declarations -----*/
+
+int grow_slab(slab_t *slab);
+
+/*----- Slab Functions -----*/
+
+int setup_slab(slab_t *slab, int elem_len, int slab_len) {
+  if (elem_len <= 0 || slab_len <= 0) return SLAB_INVAL;
+
+  // Every object has to be able to hold a free list pointer, and stay aligned for whatever
+  // gets stored in it.
+  int align = sizeof(slab_align_t);
+  if (elem_len < (int) sizeof(void *)) elem_len = sizeof(void *);
+  slab->elem_len = (elem_len + align - 1) / align * align;
+  slab->slab_len = slab_len;
+  slab->free_list = NULL;
+  slab->slabs = NULL;
+  slab->allocs = 0;
+  slab->frees = 0;
+  slab->grows = 0;
+  slab->live = 0;
+  return SLAB_SUCCESS;
+}
+
+// Function is responsible for creating a slab struct.
+slab_t *create_slab(int elem_len, int slab_len) {
+  slab_t *slab = malloc(sizeof(slab_t));
+
+  if (slab) {
+    slab->dynamic = 1;
+    if (setup_slab(slab, elem_len, slab_len) != SLAB_SUCCESS) {
+      free(slab);
+      slab = NULL;
+    }
+  }
+
+  return slab;
+}
+
+int init_slab(slab_t *slab, int elem_len, int slab_len) {
+  if (slab) {
+    slab->dynamic = 0;
+    return setup_slab(slab, elem_len, slab_len);
+  }
+  return SLAB_INVAL;
+}
+
+// Function hands out an object, only going to malloc if every object is already in use.
+// Object contents are whatever the last user left behind.
+void *slab_alloc(slab_t *slab) {
+  if (!slab || (!slab->free_list && grow_slab(slab) != SLAB_SUCCESS)) return NULL;
+
+  void *elem = slab->free_list;
+  slab->free_list = *(void **) elem;
+  slab->allocs++;
+  slab->live++;
+  return elem;
+}
+
+void slab_free(slab_t *slab, void *elem) {
+  if (!slab || !elem) return;
+
+  *(void **) elem = slab->free_list;
+  slab->free_list = elem;
+  slab->frees++;
+  slab->live--;
+}
+
+void destroy_slab(slab_t *slab) {
+  if (!slab) return;
+
+  slab_header_t *current = slab->slabs;
+  while (current) {
+    slab_header_t *tmp = current;
+    current = current->next;
+    free(tmp);
+  }
+  if (slab->dynamic) free(slab);
+}
+
+/*----- Internal Functions -----*/
+
+// Function mallocs another slab and threads all of its objects onto the free list.
+int grow_slab(slab_t *slab) {
+  slab_header_t *header = malloc(offsetof(slab_header_t, align) + (size_t) slab->elem_len * slab->slab_len);
+  if (!header) return SLAB_NOMEM;
+
+  header->next = slab->slabs;
+  slab->slabs = header;
+
+  char *objects = (char *) &header->align;
+  for (int i = slab->slab_len - 1; i >= 0; i--) {
+    void *elem = objects + (size_t) i * slab->elem_len;
+    *(void **) elem = slab->free_list;
+    slab->free_list = elem;
+  }
+  slab->grows++;
+  return SLAB_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+/*----- Numerical Constants -----*/
+
+#define SLAB_DEFAULT_LEN 64
+#define SLAB_SUCCESS 0x0
+#define SLAB_NOMEM -0x01
+#define SLAB_INVAL -0x02
+
+/*----- Type Declarations -----*/
+
+// Union has the strictest alignment of anything we'd store, since gnu99 has no max_align_t.
+typedef union slab_align {
+  long double ld;
+  long long ll;
+  void *ptr;
+  void (*fn) (void);
+} slab_align_t;
+
+// Struct represents a pool of fixed size objects, carved out of slabs of slab_len objects
+// at a time. Freed objects go back on a free list and are never returned to malloc until
+// the pool is destroyed, so once a pool has grown to its working size it never calls malloc
+// again. Not threadsafe, belongs to whoever already holds a lock over the objects.
+// The counters are only ever written by the owner, so they're safe to read from anywhere.
+typedef struct slab {
+  void *free_list, *slabs;
+  int elem_len, slab_len, dynamic;
+  long allocs, frees, grows, live;
+} slab_t;
+
+/*----- Function Declarations -----*/
+
+slab_t *create_slab(int elem_len, int slab_len);
+int init_slab(slab_t *slab, int elem_len, int slab_len);
+void *slab_alloc(slab_t *slab);
+void slab_free(slab_t *slab, void *elem);
+void destroy_slab(slab_t *slab);
+
+#endif
@@ -0,0 +1,282 @@
+/*----- System Includes -----*/
+
+#include <stdlib.h>
+#include <string.h>
+
+/*----- Local Includes -----*/
+
+#include "slotmap.h"
+
+/*----- Type Declarations -----*/
+
+// Bookkeeping for a single slot. Free slots are chained together through next_free.
+struct slot_meta {
+  uint64_t key;
+  int live, next_free;
+};
+
+/*----- Internal Function Declarations -----*/
+
+int grow_slotmap(slotmap_t *map);
+int build_index(slotmap_t *map, int index_size);
+int find_index(slotmap_t *map, uint64_t key);
+void remove_index(slotmap_t *map, int pos);
+char *slot_elem(slotmap_t *map, int slot);
+uint64_t mix_key(uint64_t key);
+
+/*----- Slotmap Functions -----*/
+
+int setup_slotmap(slotmap_t *map, int elem_len, void (*destruct) (void *)) {
+  if (elem_len <= 0 || pthread_rwlock_init(&map->lock, NULL)) return 0;
+
+  map->pages = NULL;
+  map->meta = NULL;
+  map->index = NULL;
+  map->destruct = destruct;
+  map->count = 0;
+  map->capacity = 0;
+  map->index_size = 0;
+  map->free_head = -1;
+  map->elem_len = elem_len;
+  map->frozen = 0;
+  if (grow_slotmap(map) == SLOTMAP_SUCCESS) return 1;
+
+  pthread_rwlock_destroy(&map->lock);
+  return 0;
+}
+
+// Function is responsible for creating a slotmap struct.
+slotmap_t *create_slotmap(int elem_len, void (*destruct) (void *)) {
+  slotmap_t *map = malloc(sizeof(slotmap_t));
+
+  if (map) {
+    map->dynamic = 1;
+    if (!setup_slotmap(map, elem_len, destruct)) {
+      free(map);
+      map = NULL;
+    }
+  }
+
+  return map;
+}
+
+int init_slotmap(slotmap_t *map, int elem_len, void (*destruct) (void *)) {
+  if (map) {
+    map->dynamic = 0;
+    if (setup_slotmap(map, elem_len, destruct)) return SLOTMAP_SUCCESS;
+    else return SLOTMAP_NOMEM;
+  }
+  return SLOTMAP_INVAL;
+}
+
+// Function claims a slot for key and hands back a pointer to it through elem. The slot is
+// zeroed, and it's up to the caller to finish initializing it.
+int slotmap_put(slotmap_t *map, uint64_t key, void **elem) {
+  // Validate given parameters.
+  if (!map || !elem) return SLOTMAP_INVAL;
+
+  pthread_rwlock_wrlock(&map->lock);
+  if (map->frozen) {
+    pthread_rwlock_unlock(&map->lock);
+    return SLOTMAP_FROZEN;
+  }
+
+  // Check for the key and claim the slot under the same lock.
+  int pos = find_index(map, key);
+  if (map->index[pos]) {
+    pthread_rwlock_unlock(&map->lock);
+    return SLOTMAP_EXISTS;
+  }
+
+  // Out of slots. Add a page, which rebuilds the index if it needs to grow.
+  if (map->free_head < 0) {
+    if (grow_slotmap(map) != SLOTMAP_SUCCESS) {
+      pthread_rwlock_unlock(&map->lock);
+      return SLOTMAP_NOMEM;
+    }
+    pos = find_index(map, key);
+  }
+
+  int slot = map->free_head;
+  slot_meta_t *meta = &map->meta[slot];
+  map->free_head = meta->next_free;
+  meta->key = key;
+  meta->live = 1;
+  map->index[pos] = slot + 1;
+  map->count++;
+
+  *elem = slot_elem(map, slot);
+  memset(*elem, 0, map->elem_len);
+  pthread_rwlock_unlock(&map->lock);
+  return SLOTMAP_SUCCESS;
+}
+
+// Function finds the element for key, or returns NULL if there isn't one.
+void *slotmap_get(slotmap_t *map, uint64_t key) {
+  if (!map) return NULL;
+
+  pthread_rwlock_rdlock(&map->lock);
+  int slot = map->index[find_index(map, key)];
+  void *elem = slot ? slot_elem(map, slot - 1) : NULL;
+  pthread_rwlock_unlock(&map->lock);
+
+  return elem;
+}
+
+// Function runs the destructor over the element for key and gives its slot back.
+int slotmap_drop(slotmap_t *map, uint64_t key) {
+  if (!map) return SLOTMAP_INVAL;
+
+  pthread_rwlock_wrlock(&map->lock);
+  if (map->frozen) {
+    pthread_rwlock_unlock(&map->lock);
+    return SLOTMAP_FROZEN;
+  }
+
+  int pos = find_index(map, key), slot = map->index[pos] - 1;
+  if (slot < 0) {
+    pthread_rwlock_unlock(&map->lock);
+    return SLOTMAP_NOTFOUND;
+  }
+
+  if (map->destruct) map->destruct(slot_elem(map, slot));
+  remove_index(map, pos);
+  map->meta[slot].live = 0;
+  map->meta[slot].next_free = map->free_head;
+  map->free_head = slot;
+  map->count--;
+
+  pthread_rwlock_unlock(&map->lock);
+  return SLOTMAP_SUCCESS;
+}
+
+// Function returns the next live element at or after *cursor, and moves the cursor past
+// it. Start the cursor at zero. Returns NULL once everything has been visited.
+// Dropping the element just returned is fine, elements never move.
+void *slotmap_next(slotmap_t *map, int *cursor) {
+  if (!map || !cursor) return NULL;
+
+  void *elem = NULL;
+  pthread_rwlock_rdlock(&map->lock);
+  while (*cursor < map->capacity && !elem) {
+    int slot = (*cursor)++;
+    if (map->meta[slot].live) elem = slot_elem(map, slot);
+  }
+  pthread_rwlock_unlock(&map->lock);
+
+  return elem;
+}
+
+void slotmap_freeze(slotmap_t *map) {
+  if (!map) return;
+
+  pthread_rwlock_wrlock(&map->lock);
+  map->frozen = 1;
+  pthread_rwlock_unlock(&map->lock);
+}
+
+void destroy_slotmap(slotmap_t *map) {
+  if (!map) return;
+
+  pthread_rwlock_wrlock(&map->lock);
+  for (int i = 0; i < map->capacity; i++) {
+    if (map->meta[i].live && map->destruct) map->destruct(slot_elem(map, i));
+  }
+  for (int i = 0; i < map->capacity / SLOTMAP_PAGE_LEN; i++) free(map->pages[i]);
+  free(map->pages);
+  free(map->meta);
+  free(map->index);
+
+  pthread_rwlock_unlock(&map->lock);
+  pthread_rwlock_destroy(&map->lock);
+  if (map->dynamic) free(map);
+}
+
+/*----- Internal Functions -----*/
+
+// Function adds a page of slots, and keeps the index at no more than half full.
+// Only ever called with the write lock held.
+int grow_slotmap(slotmap_t *map) {
+  int num_pages = map->capacity / SLOTMAP_PAGE_LEN, capacity = map->capacity + SLOTMAP_PAGE_LEN;
+
+  char *page = calloc(SLOTMAP_PAGE_LEN, map->elem_len);
+  char **pages = realloc(map->pages, sizeof(char *) * (num_pages + 1));
+  if (pages) map->pages = pages;
+  slot_meta_t *meta = realloc(map->meta, sizeof(slot_meta_t) * capacity);
+  if (meta) map->meta = meta;
+  if (!page || !pages || !meta) {
+    free(page);
+    return SLOTMAP_NOMEM;
+  }
+
+  if (map->index_size < capacity * 2) {
+    int index_size = map->index_size ? map->index_size : SLOTMAP_PAGE_LEN;
+    while (index_size < capacity * 2) index_size *= 2;
+    if (build_index(map, index_size) != SLOTMAP_SUCCESS) {
+      free(page);
+      return SLOTMAP_NOMEM;
+    }
+  }
+
+  // Push the new slots so that the lowest one comes off the free list first.
+  map->pages[num_pages] = page;
+  for (int i = capacity - 1; i >= map->capacity; i--) {
+    map->meta[i].live = 0;
+    map->meta[i].next_free = map->free_head;
+    map->free_head = i;
+  }
+  map->capacity = capacity;
+  return SLOTMAP_SUCCESS;
+}
+
+// Function rebuilds the index at a new size from the slots that are currently live.
+int build_index(slotmap_t *map, int index_size) {
+  int *index = calloc(index_size, sizeof(int));
+  if (!index) return SLOTMAP_NOMEM;
+
+  free(map->index);
+  map->index = index;
+  map->index_size = index_size;
+  for (int i = 0; i < map->capacity; i++) {
+    if (map->meta[i].live) map->index[find_index(map, map->meta[i].key)] = i + 1;
+  }
+  return SLOTMAP_SUCCESS;
+}
+
+// Function returns the index position holding key, or the empty position it would go in.
+// Index entries are slot numbers plus one, so zero means empty.
+int find_index(slotmap_t *map, uint64_t key) {
+  int mask = map->index_size - 1, pos = mix_key(key) & mask;
+  while (map->index[pos] && map->meta[map->index[pos] - 1].key != key) pos = (pos + 1) & mask;
+  return pos;
+}
+
+// Function empties an index position, pulling back anything after it that would otherwise
+// become unreachable, so the index never needs tombstones.
+void remove_index(slotmap_t *map, int pos) {
+  int mask = map->index_size - 1, next = pos;
+
+  while (map->index[next = (next + 1) & mask]) {
+    int home = mix_key(map->meta[map->index[next] - 1].key) & mask;
+
+    // Entry can move back into the hole only if its home isn't cyclically within (pos, next].
+    int between = pos <= next ? (home > pos && home <= next) : (home > pos || home <= next);
+    if (!between) {
+      map->index[pos] = map->index[next];
+      pos = next;
+    }
+  }
+  map->index[pos] = 0;
+}
+
+char *slot_elem(slotmap_t *map, int slot) {
+  return map->pages[slot / SLOTMAP_PAGE_LEN] + (slot % SLOTMAP_PAGE_LEN) * map->elem_len;
+}
+
+// Function scrambles a key for the index. Task ids come out of a counter, so they'd bunch
+// up badly without it. This is the splitmix64 finalizer.
+uint64_t mix_key(uint64_t key) {
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+  return key ^ (key >> 31);
+}
@@ -0,0 +1,48 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+/*----- System Includes -----*/
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*----- Numerical Constants -----*/
+
+#define SLOTMAP_PAGE_LEN 64
+#define SLOTMAP_SUCCESS 0x0
+#define SLOTMAP_FROZEN -0x01
+#define SLOTMAP_NOMEM -0x02
+#define SLOTMAP_INVAL -0x04
+#define SLOTMAP_EXISTS -0x08
+#define SLOTMAP_NOTFOUND -0x10
+
+/*----- Type Declarations -----*/
+
+// Per slot bookkeeping forward declaration.
+typedef struct slot_meta slot_meta_t;
+
+// Struct represents a table of fixed size elements keyed by integer. Elements are stored
+// inline in pages that are never moved or freed until the table is destroyed, so pointers
+// handed out stay good for as long as the key is in the table. Iteration walks the pages in
+// order, and lookups go through an open addressing index of slot numbers.
+typedef struct slotmap {
+  char **pages;
+  slot_meta_t *meta;
+  int *index;
+  void (*destruct) (void *);
+  int count, capacity, index_size, free_head, elem_len, dynamic, frozen;
+  pthread_rwlock_t lock;
+} slotmap_t;
+
+/*----- Function Declarations -----*/
+
+slotmap_t *create_slotmap(int elem_len, void (*destruct) (void *));
+int init_slotmap(slotmap_t *map, int elem_len, void (*destruct) (void *));
+int slotmap_put(slotmap_t *map, uint64_t key, void **elem);
+void *slotmap_get(slotmap_t *map, uint64_t key);
+int slotmap_drop(slotmap_t *map, uint64_t key);
+void *slotmap_next(slotmap_t *map, int *cursor);
+void slotmap_freeze(slotmap_t *map);
+void destroy_slotmap(slotmap_t *map);
+
+#endif
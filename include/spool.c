@@ -0,0 +1,356 @@
+/*----- System Includes -----*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*----- Local Includes -----*/
+
+#include "spool.h"
+
+/*----- Type Declarations -----*/
+
+// Header living at the front of every segment file. Counts are in elements, not bytes.
+// written is only ever bumped after the element has been copied in, so a segment
+// recovered after a crash never exposes a half written element.
+typedef struct spool_header {
+  uint32_t magic, elem_len, capacity, written, read;
+} spool_header_t;
+
+// Node struct for the in memory list of mapped segments, oldest first.
+struct spool_segment {
+  unsigned long seq;
+  spool_header_t *header;
+  char *data;
+  struct spool_segment *next;
+};
+
+/*----- Internal Function Declarations -----*/
+
+spool_segment_t *create_spool_segment(spool_t *spl, unsigned long seq);
+spool_segment_t *open_spool_segment(spool_t *spl, unsigned long seq);
+void destroy_spool_segment(spool_t *spl, spool_segment_t *segment, int remove);
+void drop_spool_head(spool_t *spl);
+int recover_spool(spool_t *spl);
+void segment_path(spool_t *spl, unsigned long seq, char *path);
+int compare_seqs(const void *first, const void *second);
+
+/*----- Spool Functions -----*/
+
+int setup_spool(spool_t *spl, char *dir, int elem_len, long max_bytes, spool_policy_t policy) {
+  if (strlen(dir) >= SPOOL_MAX_DIR_LEN) return SPOOL_INVAL;
+  if (elem_len <= 0 || elem_len > SPOOL_SEGMENT_SIZE / 2) return SPOOL_INVAL;
+
+  // Make sure our directory exists. Only creates the last component, anything else
+  // is the job of whoever installed us.
+  if (mkdir(dir, 0700) && errno != EEXIST) return SPOOL_IOERR;
+  if (pthread_mutex_init(&spl->mutex, NULL)) return SPOOL_NOMEM;
+
+  strcpy(spl->dir, dir);
+  spl->head = NULL;
+  spl->tail = NULL;
+  spl->policy = policy;
+  spl->next_seq = 0;
+  spl->count = 0;
+  spl->dropped = 0;
+  spl->elem_len = elem_len;
+  spl->num_segments = 0;
+  spl->max_segments = max_bytes / SPOOL_SEGMENT_SIZE;
+  if (spl->max_segments < SPOOL_MIN_SEGMENTS) spl->max_segments = SPOOL_MIN_SEGMENTS;
+
+  // Pick up anything left behind by a previous run.
+  int retval = recover_spool(spl);
+  if (retval != SPOOL_SUCCESS) pthread_mutex_destroy(&spl->mutex);
+  return retval;
+}
+
+// Function is responsible for creating a spool struct.
+spool_t *create_spool(char *dir, int elem_len, long max_bytes, spool_policy_t policy) {
+  if (!dir) return NULL;
+  spool_t *spl = malloc(sizeof(spool_t));
+
+  if (spl) {
+    spl->dynamic = 1;
+    if (setup_spool(spl, dir, elem_len, max_bytes, policy) != SPOOL_SUCCESS) {
+      free(spl);
+      spl = NULL;
+    }
+  }
+
+  return spl;
+}
+
+int init_spool(spool_t *spl, char *dir, int elem_len, long max_bytes, spool_policy_t policy) {
+  if (spl && dir) {
+    spl->dynamic = 0;
+    return setup_spool(spl, dir, elem_len, max_bytes, policy);
+  }
+  return SPOOL_INVAL;
+}
+
+// Function appends a single element to the end of the spool, rolling over to a new
+// segment, and applying the drop policy, as necessary.
+int spool_append(spool_t *spl, void *data) {
+  // Validate given parameters.
+  if (!spl || !data) return SPOOL_INVAL;
+
+  pthread_mutex_lock(&spl->mutex);
+
+  spool_segment_t *tail = spl->tail;
+  if (!tail || tail->header->written == tail->header->capacity) {
+    // Need a new segment. Check if we're allowed to have one.
+    if (spl->num_segments >= spl->max_segments) {
+      if (spl->policy == SPOOL_DROP_NEWEST) {
+        spl->dropped++;
+        pthread_mutex_unlock(&spl->mutex);
+        return SPOOL_FULL;
+      }
+      drop_spool_head(spl);
+    }
+
+    tail = create_spool_segment(spl, spl->next_seq++);
+    if (!tail) {
+      pthread_mutex_unlock(&spl->mutex);
+      return SPOOL_IOERR;
+    }
+    if (spl->tail) spl->tail->next = tail;
+    else spl->head = tail;
+    spl->tail = tail;
+  }
+
+  // Copy the element in before publishing it.
+  memcpy(tail->data + (long) tail->header->written * spl->elem_len, data, spl->elem_len);
+  tail->header->written++;
+  spl->count++;
+
+  pthread_mutex_unlock(&spl->mutex);
+  return SPOOL_SUCCESS;
+}
+
+// Function copies up to max of the oldest elements into buf without consuming them.
+// Never crosses a segment boundary, so may return fewer elements than are available.
+// Returns the number of elements copied, or SPOOL_EMPTY.
+int spool_peek(spool_t *spl, void *buf, int max) {
+  // Validate given parameters.
+  if (!spl || !buf || max <= 0) return SPOOL_INVAL;
+
+  pthread_mutex_lock(&spl->mutex);
+
+  // Throw away any segments we've finished with.
+  spool_segment_t *head = spl->head;
+  while (head && head != spl->tail && head->header->read == head->header->written) {
+    drop_spool_head(spl);
+    head = spl->head;
+  }
+  if (!head || head->header->read == head->header->written) {
+    pthread_mutex_unlock(&spl->mutex);
+    return SPOOL_EMPTY;
+  }
+
+  int available = head->header->written - head->header->read;
+  int num = available < max ? available : max;
+  memcpy(buf, head->data + (long) head->header->read * spl->elem_len, (long) num * spl->elem_len);
+
+  pthread_mutex_unlock(&spl->mutex);
+  return num;
+}
+
+// Function consumes num elements from the front of the spool. Meant to be called with
+// the value returned from spool_peek once those elements have been dealt with.
+int spool_advance(spool_t *spl, int num) {
+  // Validate given parameters.
+  if (!spl || num < 0) return SPOOL_INVAL;
+
+  pthread_mutex_lock(&spl->mutex);
+
+  spool_segment_t *head = spl->head;
+  if (!head || (int) (head->header->written - head->header->read) < num) {
+    pthread_mutex_unlock(&spl->mutex);
+    return SPOOL_INVAL;
+  }
+  head->header->read += num;
+  spl->count -= num;
+
+  // Drop the segment as soon as it's been both filled and drained.
+  if (head->header->read == head->header->capacity) drop_spool_head(spl);
+
+  pthread_mutex_unlock(&spl->mutex);
+  return SPOOL_SUCCESS;
+}
+
+// Function is responsible for destroying a spool. Segment files are intentionally left
+// on disk so that they can be recovered by the next run.
+void destroy_spool(spool_t *spl) {
+  if (!spl) return;
+
+  pthread_mutex_lock(&spl->mutex);
+  spool_segment_t *current = spl->head;
+  while (current) {
+    spool_segment_t *tmp = current;
+    current = current->next;
+    destroy_spool_segment(spl, tmp, 0);
+  }
+  pthread_mutex_unlock(&spl->mutex);
+  pthread_mutex_destroy(&spl->mutex);
+
+  if (spl->dynamic) free(spl);
+}
+
+/*----- Spool Segment Functions -----*/
+
+// Function is responsible for creating, sizing, and mapping a brand new segment file.
+spool_segment_t *create_spool_segment(spool_t *spl, unsigned long seq) {
+  char path[SPOOL_MAX_PATH_LEN];
+  segment_path(spl, seq, path);
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return NULL;
+  if (ftruncate(fd, SPOOL_SEGMENT_SIZE)) {
+    close(fd);
+    unlink(path);
+    return NULL;
+  }
+  close(fd);
+
+  spool_segment_t *segment = open_spool_segment(spl, seq);
+  if (segment) {
+    segment->header->magic = SPOOL_MAGIC;
+    segment->header->elem_len = spl->elem_len;
+    segment->header->capacity = (SPOOL_SEGMENT_SIZE - sizeof(spool_header_t)) / spl->elem_len;
+    segment->header->written = 0;
+    segment->header->read = 0;
+    spl->num_segments++;
+  } else {
+    unlink(path);
+  }
+  return segment;
+}
+
+// Function is responsible for mapping an existing segment file.
+spool_segment_t *open_spool_segment(spool_t *spl, unsigned long seq) {
+  char path[SPOOL_MAX_PATH_LEN];
+  segment_path(spl, seq, path);
+
+  spool_segment_t *segment = malloc(sizeof(spool_segment_t));
+  if (!segment) return NULL;
+
+  int fd = open(path, O_RDWR);
+  if (fd < 0) {
+    free(segment);
+    return NULL;
+  }
+  void *map = mmap(NULL, SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    free(segment);
+    return NULL;
+  }
+
+  segment->seq = seq;
+  segment->header = map;
+  segment->data = (char *) map + sizeof(spool_header_t);
+  segment->next = NULL;
+  return segment;
+}
+
+// Function is responsible for unmapping a segment, and removing its file if asked.
+void destroy_spool_segment(spool_t *spl, spool_segment_t *segment, int remove) {
+  if (remove) {
+    char path[SPOOL_MAX_PATH_LEN];
+    segment_path(spl, segment->seq, path);
+    unlink(path);
+  } else {
+    msync(segment->header, SPOOL_SEGMENT_SIZE, MS_ASYNC);
+  }
+  munmap(segment->header, SPOOL_SEGMENT_SIZE);
+  free(segment);
+}
+
+// Function throws away the oldest segment, and anything left unread in it.
+// Expects the spool mutex to be held.
+void drop_spool_head(spool_t *spl) {
+  spool_segment_t *head = spl->head;
+  if (!head) return;
+
+  long unread = head->header->written - head->header->read;
+  spl->count -= unread;
+  spl->dropped += unread;
+  spl->head = head->next;
+  if (!spl->head) spl->tail = NULL;
+  spl->num_segments--;
+  destroy_spool_segment(spl, head, 1);
+}
+
+// Function maps any segments left behind by a previous run, in order, discarding
+// anything that doesn't look like one of ours.
+int recover_spool(spool_t *spl) {
+  DIR *directory = opendir(spl->dir);
+  if (!directory) return SPOOL_IOERR;
+
+  int num_seqs = 0, max_seqs = 16;
+  unsigned long *seqs = malloc(sizeof(unsigned long) * max_seqs);
+  if (!seqs) {
+    closedir(directory);
+    return SPOOL_NOMEM;
+  }
+
+  // Collect sequence numbers of all segment files.
+  for (struct dirent *entry = readdir(directory); entry; entry = readdir(directory)) {
+    unsigned long seq;
+    if (sscanf(entry->d_name, "segment.%lu", &seq) != 1) continue;
+    if (num_seqs == max_seqs) {
+      unsigned long *tmp = realloc(seqs, sizeof(unsigned long) * (max_seqs *= 2));
+      if (!tmp) {
+        free(seqs);
+        closedir(directory);
+        return SPOOL_NOMEM;
+      }
+      seqs = tmp;
+    }
+    seqs[num_seqs++] = seq;
+  }
+  closedir(directory);
+  qsort(seqs, num_seqs, sizeof(unsigned long), compare_seqs);
+
+  // Map them back in, oldest first.
+  for (int i = 0; i < num_seqs; i++) {
+    spool_segment_t *segment = open_spool_segment(spl, seqs[i]);
+    if (!segment) continue;
+
+    spool_header_t *header = segment->header;
+    if (header->magic != SPOOL_MAGIC || (int) header->elem_len != spl->elem_len || header->read > header->written
+        || header->written > header->capacity || header->read == header->written) {
+      // Either garbage, written by an incompatible build, or fully drained.
+      destroy_spool_segment(spl, segment, 1);
+      continue;
+    }
+
+    if (spl->tail) spl->tail->next = segment;
+    else spl->head = segment;
+    spl->tail = segment;
+    spl->num_segments++;
+    spl->count += header->written - header->read;
+  }
+  if (num_seqs) spl->next_seq = seqs[num_seqs - 1] + 1;
+  free(seqs);
+
+  // Honor the cap even if it was lowered since the last run.
+  while (spl->num_segments > spl->max_segments) drop_spool_head(spl);
+  return SPOOL_SUCCESS;
+}
+
+// Function writes the path of the segment file with the given sequence number into path.
+void segment_path(spool_t *spl, unsigned long seq, char *path) {
+  snprintf(path, SPOOL_MAX_PATH_LEN, "%s/segment.%010lu", spl->dir, seq);
+}
+
+int compare_seqs(const void *first, const void *second) {
+  unsigned long lhs = *(const unsigned long *) first, rhs = *(const unsigned long *) second;
+  return (lhs > rhs) - (lhs < rhs);
+}
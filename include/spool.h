@@ -0,0 +1,56 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+/*----- System Includes -----*/
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*----- Numerical Constants -----*/
+
+#define SPOOL_SEGMENT_SIZE (1 << 20)
+#define SPOOL_MIN_SEGMENTS 2
+#define SPOOL_MAX_PATH_LEN 256
+#define SPOOL_MAX_DIR_LEN 224
+#define SPOOL_MAGIC 0x4e475350
+#define SPOOL_SUCCESS 0x0
+#define SPOOL_FULL -0x01
+#define SPOOL_NOMEM -0x02
+#define SPOOL_INVAL -0x04
+#define SPOOL_EMPTY -0x08
+#define SPOOL_IOERR -0x10
+
+/*----- Type Declarations -----*/
+
+// Segment forward declaration.
+typedef struct spool_segment spool_segment_t;
+
+// Decides what gets thrown away once the spool has hit its size cap.
+typedef enum {
+  SPOOL_DROP_OLDEST,
+  SPOOL_DROP_NEWEST
+} spool_policy_t;
+
+// Struct represents a threadsafe, disk backed, FIFO queue of fixed size elements.
+// Elements are appended into mmap'ed segment files, so anything in the spool survives
+// a restart of the process.
+typedef struct spool {
+  char dir[SPOOL_MAX_DIR_LEN];
+  spool_segment_t *head, *tail;
+  spool_policy_t policy;
+  unsigned long next_seq;
+  long count, dropped;
+  int elem_len, num_segments, max_segments, dynamic;
+  pthread_mutex_t mutex;
+} spool_t;
+
+/*----- Function Declarations -----*/
+
+spool_t *create_spool(char *dir, int elem_len, long max_bytes, spool_policy_t policy);
+int init_spool(spool_t *spl, char *dir, int elem_len, long max_bytes, spool_policy_t policy);
+int spool_append(spool_t *spl, void *data);
+int spool_peek(spool_t *spl, void *buf, int max);
+int spool_advance(spool_t *spl, int num);
+void destroy_spool(spool_t *spl);
+
+#endif
@@ -0,0 +1,190 @@
+/*----- System Includes -----*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/*----- Local Includes -----*/
+
+#include "trace.h"
+
+/*----- Internal Function Declarations -----*/
+
+trace_ring_t *claim_ring();
+void create_ring_key();
+void release_ring(void *voidring);
+int snapshot_ring(trace_ring_t *ring, trace_event_t *copy);
+
+/*----- Evil but Necessary Globals -----*/
+
+// Tracing is per process, so the rings have to live somewhere everyone can find them.
+// Slots in rings are only ever filled in, never emptied, until destroy_trace. Events from
+// threads that couldn't get a ring are counted in lost.
+static trace_ring_t *rings[TRACE_MAX_RINGS];
+static int num_rings = 0, next_tid = 0, enabled = 0;
+static long lost = 0;
+static __thread trace_ring_t *own_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+/*----- Trace Functions -----*/
+
+// Function turns tracing on. Until it's called, recording an event costs a single load, and
+// no rings are ever allocated. Threads started before it's called aren't named.
+void trace_enable() {
+  __atomic_store_n(&enabled, 1, __ATOMIC_RELEASE);
+}
+
+// Function names the calling thread's ring, so it shows up as something recognizable in
+// the trace viewer.
+void trace_thread(const char *name) {
+  if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) return;
+  trace_ring_t *ring = own_ring ? own_ring : claim_ring();
+  if (ring) snprintf(ring->name, TRACE_MAX_NAME_LEN, "%s", name);
+}
+
+// Function records an event on the calling thread's ring, overwriting the oldest one. Costs
+// a clock read and a few stores, and never blocks, so it's fine to call from anywhere.
+void trace_event(const char *name, trace_phase_t phase, int64_t value) {
+  struct timespec now;
+  trace_ring_t *ring = own_ring;
+  if (!ring && !__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) return;
+  if (!ring && !(ring = claim_ring())) {
+    __atomic_add_fetch(&lost, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  // Readers check head after copying an event out, so it has to be seen to move before
+  // the slot it frees up starts changing.
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t head = ring->head;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  trace_event_t *event = &ring->events[head & (TRACE_RING_LEN - 1)];
+  event->ts = now.tv_sec * 1000000000ull + now.tv_nsec;
+  event->name = name;
+  event->value = value;
+  event->tid = ring->tid;
+  event->phase = phase;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Function writes every ring out as Chrome trace JSON, which Perfetto also reads. If max_len
+// is positive, each ring gets an even share of it and only its newest events that fit are
+// written. Events lost to threads that never got a ring are counted in otherData. Doesn't
+// stop anyone from tracing while it runs.
+int trace_write(FILE *out, long max_len) {
+  if (!out) return TRACE_INVAL;
+  trace_event_t *copy = malloc(sizeof(trace_event_t) * TRACE_RING_LEN);
+  if (!copy) return TRACE_NOMEM;
+
+  int pid = getpid(), count = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+  if (count > TRACE_MAX_RINGS) count = TRACE_MAX_RINGS;
+  long remaining = max_len - fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"lost_events\":%ld},\"traceEvents\":[",
+      __atomic_load_n(&lost, __ATOMIC_RELAXED)) - 2;
+  int first = 1;
+
+  for (int i = 0; i < count; i++) {
+    trace_ring_t *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+    if (!ring) continue;
+    int num = snapshot_ring(ring, copy), skip = 0;
+
+    // Leave room for the thread's name, and then as many events as we've got room for.
+    if (max_len > 0) {
+      long fits = remaining / (count - i) / TRACE_EVENT_MAX_LEN - 1;
+      if (fits < 0) fits = 0;
+      if (num > fits) skip = num - fits;
+    }
+
+    if (__atomic_load_n(&ring->owned, __ATOMIC_ACQUIRE) && (max_len <= 0 || skip < num)) {
+      remaining -= fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%.*s\"}}",
+          first ? "" : ",", pid, ring->tid, TRACE_MAX_NAME_LEN - 1, ring->name);
+      first = 0;
+    }
+    for (int j = skip; j < num; j++) {
+      trace_event_t *event = &copy[j];
+      remaining -= fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%lld}}",
+          first ? "" : ",", event->name, event->phase, event->phase == TRACE_INSTANT ? "\"s\":\"t\"," : "",
+          (unsigned long long) event->ts / 1000, (unsigned long long) event->ts % 1000, pid, event->tid, (long long) event->value);
+      first = 0;
+    }
+  }
+  fprintf(out, "]}");
+  free(copy);
+  return ferror(out) ? TRACE_IOERR : TRACE_SUCCESS;
+}
+
+// Function frees every ring. Anyone still tracing at this point would be writing into freed
+// memory, so all other threads have to be gone first.
+void destroy_trace() {
+  int count = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+  if (count > TRACE_MAX_RINGS) count = TRACE_MAX_RINGS;
+  for (int i = 0; i < count; i++) {
+    free(rings[i]);
+    rings[i] = NULL;
+  }
+  num_rings = 0;
+  lost = 0;
+  own_ring = NULL;
+}
+
+/*----- Internal Functions -----*/
+
+// Function gives the calling thread a ring, reusing one left behind by a thread that's gone
+// if it can, and making a new one otherwise. Returns NULL once we're out of rings, in which
+// case the thread's events are only counted.
+trace_ring_t *claim_ring() {
+  trace_ring_t *ring = NULL;
+  pthread_once(&ring_once, create_ring_key);
+
+  int count = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+  if (count > TRACE_MAX_RINGS) count = TRACE_MAX_RINGS;
+  for (int i = 0; i < count && !ring; i++) {
+    trace_ring_t *candidate = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+    int unowned = 0;
+    if (candidate && __atomic_compare_exchange_n(&candidate->owned, &unowned, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      ring = candidate;
+    }
+  }
+
+  if (!ring) {
+    int index = __atomic_fetch_add(&num_rings, 1, __ATOMIC_ACQ_REL);
+    if (index >= TRACE_MAX_RINGS || !(ring = calloc(1, sizeof(trace_ring_t)))) return NULL;
+    ring->owned = 1;
+    __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+  }
+
+  // Every thread gets its own tid, so events left behind by a ring's last owner don't get
+  // mixed up with ours.
+  ring->tid = __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
+  snprintf(ring->name, TRACE_MAX_NAME_LEN, "thread %d", ring->tid);
+  pthread_setspecific(ring_key, ring);
+  own_ring = ring;
+  return ring;
+}
+
+void create_ring_key() {
+  pthread_key_create(&ring_key, release_ring);
+}
+
+// Function hands a ring back when its thread exits.
+void release_ring(void *voidring) {
+  trace_ring_t *ring = voidring;
+  __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+// Function copies a ring's events out, oldest first, skipping any the owner overwrote while
+// we were copying. Returns the number copied.
+int snapshot_ring(trace_ring_t *ring, trace_event_t *copy) {
+  int num = 0;
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint64_t start = head > TRACE_RING_LEN ? head - TRACE_RING_LEN : 0;
+
+  for (uint64_t i = start; i < head; i++) {
+    copy[num] = ring->events[i & (TRACE_RING_LEN - 1)];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) - i < TRACE_RING_LEN) num++;
+  }
+  return num;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*----- Numerical Constants -----*/
+
+#define TRACE_RING_LEN 1024
+#define TRACE_MAX_RINGS 256
+#define TRACE_MAX_NAME_LEN 32
+#define TRACE_EVENT_MAX_LEN 128
+#define TRACE_SUCCESS 0x0
+#define TRACE_NOMEM -0x01
+#define TRACE_INVAL -0x02
+#define TRACE_IOERR -0x04
+
+/*----- Type Declarations -----*/
+
+// Phases, as Chrome's trace viewer and Perfetto know them.
+typedef enum {
+  TRACE_BEGIN = 'B',
+  TRACE_END = 'E',
+  TRACE_INSTANT = 'i'
+} trace_phase_t;
+
+// Struct represents a single event. Names have to be string literals, or otherwise outlive
+// the process, since only the pointer is kept.
+typedef struct trace_event {
+  uint64_t ts;
+  const char *name;
+  int64_t value;
+  int tid;
+  char phase;
+} trace_event_t;
+
+// Struct represents one thread's ring of recent events. Only the owning thread ever writes
+// it, and head only ever moves forward, so readers can copy events out without a lock and
+// then check whether the owner lapped them while they were at it. Rings outlive their
+// threads, and get picked up again by the next thread to start, so the last moments of a
+// thread that's gone are still around to look at.
+typedef struct trace_ring {
+  trace_event_t events[TRACE_RING_LEN];
+  uint64_t head;
+  int owned, tid;
+  char name[TRACE_MAX_NAME_LEN];
+} trace_ring_t;
+
+/*----- Function Declarations -----*/
+
+void trace_enable();
+void trace_thread(const char *name);
+void trace_event(const char *name, trace_phase_t phase, int64_t value);
+int trace_write(FILE *out, long max_len);
+void destroy_trace();
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -13,13 +14,22 @@
 #include <syslog.h>
 #include <time.h>
 #include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 /*----- Local Includes -----*/
 
 #include "monitor.h"
 #include "worker.h"
-#include "../include/hash.h"
+#include "sampler.h"
+#include "../include/slotmap.h"
 #include "../include/list.h"
+#include "../include/spool.h"
+#include "../include/framer.h"
+#include "../include/outbuf.h"
+#include "../include/trace.h"
 
 /*----- Macro Declarations -----*/
 
@@ -43,62 +53,118 @@
     return;                                                                 \
   } while (0);
 
-// This is not supposed to be a generic max function, and has tons of pitfalls.
-// Really just meant to return the greatest of two, not being incremented, ints.
-#define SIMPLE_MAX(x, y) (((x) > (y)) ? (x) : (y))
+// Report timestamps are wall clock seconds, down to the nanosecond. Anyone only reading the
+// whole seconds still gets the same answer they always have.
+#define NOTGIOS_TIMESTAMP_FMT "%ld.%09ld"
+#define NOTGIOS_TIMESTAMP_ARGS(ts) (long) (ts).tv_sec, (long) (ts).tv_nsec
 
 /*----- Local Function Declarations -----*/
 
 // Thread Management Functions
 void *launch_worker_thread(void *args);
 void handle_add(char **commands, char *reply_buf);
+void handle_batch(char *frame, char *reply_buf, int reply_len);
+char *parse_task(char **commands, thread_args_t *arguments);
+char *start_task(thread_args_t *arguments);
 void handle_reschedule(char *cmd, char *reply_buf, task_action_t action);
-
-// Signal Handlers
-void handle_signal(int signo);
+void handle_stats(char *reply_buf, int reply_len);
+int format_histograms(char *buffer, int len, histogram_t *collect, histogram_t *lateness, long missed);
+void start_task_timing();
+task_timing_t *create_task_timing();
+
+// Event Handlers
+int handle_events(int socket);
+int handle_frames(char *buffer);
+int handle_command(char *buffer);
+void handle_signals();
+void handle_trace(char *reply_buf, int reply_len);
+void handle_log_level(char *cmd, char *reply_buf);
+void log_sink(int priority, char *message);
+void dump_trace();
 void handle_term();
 void handle_child();
+int shutdown_monitor(int socket);
 
 // High Level Network Functions
-void send_reports(int socket);
+void send_reports();
+int send_alarms();
+int check_throttle();
+int drain_spool();
+void spool_reports();
+unsigned long stamp_report(char *buffer);
+void unstamp_report(unsigned long seq);
+void retain_report(char *frame, int len, unsigned long seq);
+void ack_reports(unsigned long acked);
+void forget_report();
+int resend_unacked();
+int format_report(task_report_t *report, char *buffer);
+void format_alarm(alarm_report_t *alarm, char *buffer);
+void queue_report(task_t *task, task_report_t *report);
+task_t *find_task(char *id);
+void count_drop(char *id);
+void append_drops(task_report_t *report, char *buffer);
+void append_interval(task_report_t *report, char *buffer);
+void append_window(task_report_t *report, char *buffer);
+int plain_report(void *voidreport);
 int handle_process_total_report(task_report_t *report, char *start, char *buffer);
 int handle_directory_report(task_report_t *report, char *start, char *buffer);
 int handle_disk_report(task_report_t *report, char *start, char *buffer);
 int handle_swap_report(task_report_t *report, char *start, char *buffer);
 int handle_load_report(task_report_t *report, char *start, char *buffer);
+int handle_self_report(task_report_t *report, char *start, char *buffer);
 
 // Low Level Network Functions
 int create_server(short port);
-int handshake(char *server_hostname, int port, int initial, short monitor_port);
-int handle_read(int fd, char *buffer, int len);
+int handshake(char *server_hostname, int port, int initial, short monitor_port, int *direct);
+int handle_read(int fd, framer_t *frm, char *buffer, int len);
 int handle_write(int fd, char *buffer);
+int send_message(char *buffer);
+int flush_outbound();
+void watch_writable(int on);
+void drain_outbound(int timeout);
+int wait_readable(int fd, int timeout);
+void arm_read_timer();
 
 // Utility Functions
 int parse_commands(char **output, char *input);
-thread_control_t *create_thread_control();
-void destroy_thread_control(void *voidarg);
+int parse_task_key(char *id, uint64_t *key);
+void init_thread_control(thread_control_t *control);
+void destroy_task(void *voidarg);
 void remove_dead();
 void increment_stats(task_type_t type, char *id);
 void decrement_stats(task_type_t type, char *id);
+void record_timing(histogram_t *task_hist, histogram_t *type_hist, struct timespec *start, struct timespec *end);
+void schedule_first(struct timespec *deadline, int freq_ms, uint64_t key);
+long schedule_next(struct timespec *deadline, int freq_ms, struct timespec *now);
 void user_error();
 
 /*----- Evil but Necessary Globals -----*/
 
-hash_t threads, controls, children;
-list_t reports;
+slotmap_t tasks;
+list_t reports, alarms;
+spool_t spool;
+framer_t inbound;
+outbuf_t outbound;
+sent_report_t *unacked;
 monitor_stats_t task_stats;
-pthread_rwlock_t stats_lock;
-int termpipe_in, termpipe_out, exiting = 0;
+int events_fd, signal_fd, report_event, task_event, read_timer;
+int connection = -1, exiting = 0, connected = 0, spooling = 0, unacked_start = 0, unacked_count = 0;
+int writing = 0, throttled = 0, ever_connected = 0, timing_tasks = 0;
+unsigned long next_seq = 1;
+char session[NOTGIOS_MAX_SESSION_LEN];
+char *trace_path = NULL;
 
 /*----- Function Implementations -----*/
 
 int main(int argc, char **argv) {
-  int c, port = 0, server_socket = 0, initial = 1;
-  char *server_hostname = NULL;
+  int c, port = 0, server_socket = 0, initial = 1, spool_mb = NOTGIOS_SPOOL_MAX_MB, queue_max = NOTGIOS_QUEUE_MAX;
+  char *server_hostname = NULL, *spool_dir = NOTGIOS_SPOOL_DIR;
+  spool_policy_t spool_policy = SPOOL_DROP_OLDEST;
+  list_policy_t queue_policy = LIST_DROP_OLDEST;
 
   // Parse command line args.
   opterr = 0;
-  while ((c = getopt(argc, argv, "s:p:")) != -1) {
+  while ((c = getopt(argc, argv, "s:p:d:m:x:b:o:t:r:")) != -1) {
     switch (c) {
       case 's':
         server_hostname = optarg;
@@ -106,6 +172,32 @@ int main(int argc, char **argv) {
       case 'p':
         port = atoi(optarg);
         break;
+      case 'd':
+        spool_dir = optarg;
+        break;
+      case 'm':
+        spool_mb = atoi(optarg);
+        break;
+      case 'x':
+        if (!strcmp(optarg, "oldest")) spool_policy = SPOOL_DROP_OLDEST;
+        else if (!strcmp(optarg, "newest")) spool_policy = SPOOL_DROP_NEWEST;
+        else user_error();
+        break;
+      case 'b':
+        queue_max = atoi(optarg);
+        break;
+      case 't':
+        trace_path = optarg;
+        break;
+      case 'r':
+        proc_root = optarg;
+        break;
+      case 'o':
+        if (!strcmp(optarg, "oldest")) queue_policy = LIST_DROP_OLDEST;
+        else if (!strcmp(optarg, "newest")) queue_policy = LIST_DROP_NEWEST;
+        else if (!strcmp(optarg, "coalesce")) queue_policy = LIST_COALESCE;
+        else user_error();
+        break;
       default:
         user_error();
         return EXIT_FAILURE;
@@ -120,26 +212,37 @@ int main(int argc, char **argv) {
 #ifndef DEBUG
   openlog("Notgios Monitor", 0, 0);
 #endif
-  int retvals[4];
-  retvals[0] = init_hash(&threads, free);
-  retvals[1] = init_hash(&controls, destroy_thread_control);
-  retvals[2] = init_hash(&children, free);
-  retvals[3] = init_list(&reports, sizeof(task_report_t), free);
-  if (retvals[0] || retvals[1] || retvals[2] || retvals[3]) {
+  if (init_logger(NOTGIOS_LOG_LEVEL, log_sink) == LOGGER_SUCCESS) atexit(destroy_logger);
+  int retvals[7];
+  retvals[0] = init_slotmap(&tasks, sizeof(task_t), destroy_task);
+  retvals[1] = init_list(&reports, sizeof(task_report_t), NULL);
+  retvals[2] = list_bound(&reports, queue_max, queue_policy, plain_report);
+  retvals[3] = init_framer(&inbound, NOTGIOS_FRAME_BUFSIZE);
+  retvals[4] = init_outbuf(&outbound, NOTGIOS_FRAME_BUFSIZE);
+  retvals[5] = init_list(&alarms, sizeof(alarm_report_t), NULL);
+  retvals[6] = list_bound(&alarms, NOTGIOS_ALARM_QUEUE_MAX, LIST_DROP_OLDEST, NULL);
+  unacked = calloc(NOTGIOS_UNACKED_MAX, sizeof(sent_report_t));
+  if (retvals[0] || retvals[1] || retvals[2] || retvals[3] || retvals[4] || retvals[5] || retvals[6] || !unacked) {
     write_log(LOG_ERR, "Monitor: Failed to initialize necessary tables and lists, exiting...\n");
     return EXIT_FAILURE;
   }
-  int pipes[2];
-  if (pipe(pipes)) {
-    write_log(LOG_ERR, "Monitor: Failed to open termination pipe, exiting...\n");
-    return EXIT_FAILURE;
+
+  // The spool is a nice to have. If we can't get at our directory, run without it and
+  // queue in memory during outages like we always have.
+  if (spool_mb > 0 && !init_spool(&spool, spool_dir, sizeof(task_report_t), spool_mb * 1024L * 1024L, spool_policy)) {
+    spooling = 1;
+    if (spool.count) write_log(LOG_INFO, "Monitor: Recovered %ld spooled reports from a previous run...\n", spool.count);
+  } else if (spool_mb > 0) {
+    write_log(LOG_ERR, "Monitor: Failed to open report spool in %s, continuing without it...\n", spool_dir);
   }
-  termpipe_out = pipes[0];
-  termpipe_in = pipes[1];
-  pthread_rwlock_init(&stats_lock, NULL);
   memset(&task_stats, 0, sizeof(monitor_stats_t));
 
-  // Setup signal handlers.
+  // Tracing is only worth paying for when someone's going to look, which they say by giving
+  // us somewhere to put it.
+  if (trace_path) trace_enable();
+  trace_thread("main");
+
+  // Setup signal handling.
   struct sigaction sa;
   sa.sa_handler = SIG_IGN;
   sa.sa_flags = 0;
@@ -149,20 +252,44 @@ int main(int argc, char **argv) {
   retvals[0] = sigaction(SIGINT, &sa, NULL);
   retvals[1] = sigaction(SIGPIPE, &sa, NULL);
 
-  // Handle SIGCHLD and SIGTERMs. Also, block those signals while handling them.
-  sigaddset(&sa.sa_mask, SIGTERM);
-  sa.sa_handler = handle_signal;
-  retvals[2] = sigaction(SIGCHLD, &sa, NULL);
-  sigemptyset(&sa.sa_mask);
-  sigaddset(&sa.sa_mask, SIGCHLD);
-  retvals[3] = sigaction(SIGTERM, &sa, NULL);
+  // SIGCHLD, SIGTERM and SIGUSR1 are delivered through a signalfd and handled by the event
+  // loop like everything else. They have to be blocked before any threads are started so
+  // that every thread inherits the mask.
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  retvals[2] = sigprocmask(SIG_BLOCK, &mask, NULL);
+  signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
 
   // Check out return values.
-  if (retvals[0] || retvals[1] || retvals[2] || retvals[3]) {
+  if (retvals[0] || retvals[1] || retvals[2] || signal_fd < 0) {
     write_log(LOG_ERR, "Monitor: Failed to install all signal handlers, exiting...\n");
     return EXIT_FAILURE;
   }
 
+  // Set up the rest of the event sources. Workers bump report_event every time they queue a
+  // report, and task_event when they die. read_timer fires if the server goes quiet.
+  report_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  task_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  read_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  events_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (report_event < 0 || task_event < 0 || read_timer < 0 || events_fd < 0) {
+    write_log(LOG_ERR, "Monitor: Failed to set up the event loop, exiting...\n");
+    return EXIT_FAILURE;
+  }
+  int sources[] = {signal_fd, report_event, task_event, read_timer};
+  for (unsigned int i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = sources[i];
+    if (epoll_ctl(events_fd, EPOLL_CTL_ADD, sources[i], &event)) {
+      write_log(LOG_ERR, "Monitor: Failed to set up the event loop, exiting...\n");
+      return EXIT_FAILURE;
+    }
+  }
+
   // Outer infinite loop to allow for exceptional conditions, like the server going down.
   while (1) {
     // Server will connect to us after we send over the port, so find one that works.
@@ -184,9 +311,13 @@ int main(int argc, char **argv) {
     }
 
     // Perform the handshake with the server and act accordingly.
-    switch (handshake(server_hostname, port, initial, monitor_port)) {
+    int socket = -1;
+    switch (handshake(server_hostname, port, initial, monitor_port, &socket)) {
       case NOTGIOS_SUCCESS:
         break;
+      case NOTGIOS_IN_SHUTDOWN:
+        close(server_socket);
+        return shutdown_monitor(-1);
       case NOTGIOS_SERVER_REJECTED:
         write_log(LOG_ERR, "Monitor: Server sent back a rejection message...\n");
         user_error();
@@ -194,170 +325,343 @@ int main(int argc, char **argv) {
         write_log(LOG_ERR, "Monitor: Server doesn't appear to exist? Bad hostname...\n");
         user_error();
       default:
+        if (!initial) {
+          // Server is probably still coming back up. Give it a second and try again.
+          write_log(LOG_ERR, "Monitor: Handshake with server failed, retrying...\n");
+          close(server_socket);
+          if (wait_readable(-1, 1) == NOTGIOS_IN_SHUTDOWN) return shutdown_monitor(-1);
+          continue;
+        }
         write_log(LOG_ERR, "Monitor: Initial handshake with server failed, exiting...\n");
         return EXIT_FAILURE;
     }
     initial = 0;
 
-    write_log(LOG_INFO, "Monitor: Initial handshake completed, waiting for server to connect...\n");
-    struct timeval time;
-    time.tv_sec = NOTGIOS_ACCEPT_TIMEOUT;
-    time.tv_usec = 0;
-    fd_set to_read;
-    FD_ZERO(&to_read);
-    FD_SET(server_socket, &to_read);
-    select(server_socket + 1, &to_read, NULL, NULL, &time);
-
-    // Select returned, so check if we've timed out.
-    if (!FD_ISSET(server_socket, &to_read)) {
-      write_log(LOG_ERR, "Monitor: Timed out while waiting for server to make contact, exiting...\n");
-      return EXIT_FAILURE;
-    }
+    if (socket >= 0) {
+      // Server understands sessions, so the connection we opened is the one we keep.
+      write_log(LOG_INFO, "Monitor: Handshake completed, session %s is live...\n", session);
+    } else {
+      // Older server, it's going to dial us back.
+      write_log(LOG_INFO, "Monitor: Initial handshake completed, waiting for server to connect...\n");
+      int retval = wait_readable(server_socket, NOTGIOS_ACCEPT_TIMEOUT);
+
+      // Check if we've timed out, or were told to stop while waiting.
+      if (retval == NOTGIOS_IN_SHUTDOWN) {
+        close(server_socket);
+        return shutdown_monitor(-1);
+      } else if (!retval) {
+        write_log(LOG_ERR, "Monitor: Timed out while waiting for server to make contact, exiting...\n");
+        return EXIT_FAILURE;
+      }
 
-    // We have a connection waiting, so grab it.
-    // Also, handle potential race condition (should never come up, but we know how computers are) of
-    // socket being closed in between select and accept.
-    char buffer[NOTGIOS_STATIC_BUFSIZE];
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int socket = accept(server_socket, (struct sockaddr *) &client_addr, &client_len);
-    if (socket < 0) {
-      if (errno == EWOULDBLOCK || errno == EAGAIN) {
-        write_log(LOG_ERR, "Monitor: Server closed connection while it was being opened. Exiting to start clean...\n");
-      } else {
-        write_log(LOG_ERR, "Monitor: An unknown error occured while attempting to accept connection from server, exiting...\n");
+      // We have a connection waiting, so grab it.
+      // Also, handle potential race condition (should never come up, but we know how computers are) of
+      // socket being closed in between select and accept.
+      struct sockaddr_in client_addr;
+      socklen_t client_len = sizeof(client_addr);
+      socket = accept(server_socket, (struct sockaddr *) &client_addr, &client_len);
+      if (socket < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN) {
+          write_log(LOG_ERR, "Monitor: Server closed connection while it was being opened. Exiting to start clean...\n");
+        } else {
+          write_log(LOG_ERR, "Monitor: An unknown error occured while attempting to accept connection from server, exiting...\n");
+        }
+        return EXIT_FAILURE;
       }
-      return EXIT_FAILURE;
+      framer_clear(&inbound);
     }
     fcntl(socket, F_SETFL, O_NONBLOCK);
     write_log(LOG_INFO, "Monitor: Connected to server...\n");
+    if (ever_connected++) {
+      task_stats.reconnects++;
+      trace_event("reconnect", TRACE_INSTANT, task_stats.reconnects);
+    }
+    // A worker can slip a report into the queue just as we spool it on the way down. Spool
+    // anything like that now, so it goes out in order with the rest.
+    spool_reports();
+    connection = socket;
+    __atomic_store_n(&connected, 1, __ATOMIC_SEQ_CST);
+    writing = 0;
+    throttled = 0;
+    outbuf_clear(&outbound);
+
+    // We're connected. Everything from here on happens in response to events, until the
+    // connection goes away or we're told to stop.
+    handle_events(socket);
+
+    // Either our socket has been unexpectedly closed (server crashed), we received an orderly
+    // shutdown message from the server (server was interrupted by user, or machine server was
+    // running on was shutdown), or we received a SIGTERM.
+    // If the socket closed or the serve shutdown, we need to start buffering output and attempting to
+    // reopen the connection with the server.
+    // If we received a SIGTERM, we need to stop all tasks and shutdown.
+    close(server_socket);
+    if (exiting) return shutdown_monitor(socket);
 
-    // We're connected. Start reading jobs and stuff from the server.
-    while (!exiting) {
-      int retval = handle_read(socket, buffer, NOTGIOS_STATIC_BUFSIZE);
-      if (retval >= 0) {
-        char *commands[NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS];
-
-        if (!parse_commands(commands, buffer)) {
-          char *cmd = commands[0];
-          if (strstr(cmd, "NGS JOB ADD") == cmd) {
-            write_log(LOG_INFO, "Monitor: Received an add message...\n");
-            handle_add(commands, buffer);
-          } else if (strstr(cmd, "NGS JOB PAUS") == cmd) {
-            write_log(LOG_INFO, "Monitor: Received a pause message...\n");
-            handle_reschedule(commands[1], buffer, PAUSE);
-          } else if (strstr(cmd, "NGS JOB RES") == cmd) {
-            write_log(LOG_INFO, "Monitor: Received a resume message...\n");
-            handle_reschedule(commands[1], buffer, RESUME);
-          } else if (strstr(cmd, "NGS JOB DEL") == cmd) {
-            write_log(LOG_INFO, "Monitor: Received a delete message...\n");
-            handle_reschedule(commands[1], buffer, DELETE);
-          } else if (strstr(cmd, "NGS STILL THERE?") == cmd) {
-            // Manual keepalive. I know TCP is supposed to do stuff like this on its own, but honestly it makes
-            // it easier on my end to detect errors if I also do it manually.
-            write_log(LOG_INFO, "Monitor: Received keepalive message...\n");
-            sprintf(buffer, "NGS STILL HERE!\n\n");
-          } else if (strstr(cmd, "NGS BYE") == cmd) {
-            write_log(LOG_INFO, "Monitor: Server send a shutdown message, beginning reconnect procedures...\n");
-            break;
-          } else if (exiting) {
-            sprintf(buffer, "NGS NACK\nCAUSE SHUTDOWN\n\n");
-          } else {
-            // Shouldn't happen, but hey, everything that isn't supposed to happen eventually does, so there.
-            write_log(LOG_ERR, "Monitor: Received an invalid message, discarding...\n");
-            sprintf(buffer, "NGS NACK\nCAUSE UNRECOGNIZED_COMMAND\n\n");
+    // Anything still queued goes to disk until we're talking to the server again.
+    __atomic_store_n(&connected, 0, __ATOMIC_SEQ_CST);
+    connection = -1;
+    close(socket);
+    spool_reports();
+  }
+}
+
+// Function runs the event loop for a single connection to the server. Returns once the
+// connection is gone, the server says goodbye, or we're told to shut down.
+int handle_events(int socket) {
+  struct epoll_event events[NOTGIOS_MAX_EVENTS], event;
+  static char buffer[NOTGIOS_FRAME_BUFSIZE];
+  event.events = EPOLLIN;
+  event.data.fd = socket;
+  if (epoll_ctl(events_fd, EPOLL_CTL_ADD, socket, &event)) return NOTGIOS_SOCKET_FAILURE;
+  arm_read_timer();
+
+  // Anything the server didn't get last time around goes first, then get anything we
+  // spooled during the outage moving right away instead of waiting for the first report.
+  resend_unacked();
+  eventfd_write(report_event, 1);
+
+  // Server may have sent commands right behind its handshake reply.
+  if (handle_frames(buffer) == NOTGIOS_SOCKET_CLOSED) return NOTGIOS_SUCCESS;
+
+  while (!exiting) {
+    int num_events = epoll_wait(events_fd, events, NOTGIOS_MAX_EVENTS, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) continue;
+      write_log(LOG_ERR, "Monitor: Event loop failed, reconnecting...\n");
+      return NOTGIOS_GENERIC_ERROR;
+    }
+
+    for (int i = 0; i < num_events && !exiting; i++) {
+      int fd = events[i].data.fd;
+      eventfd_t pending;
+
+      if (fd == signal_fd) {
+        handle_signals();
+      } else if (fd == report_event) {
+        // Workers have queued reports.
+        eventfd_read(report_event, &pending);
+        send_reports();
+      } else if (fd == task_event) {
+        // A task encountered an unrecoverable error. A message has already been sent to the
+        // front end, so remove the task from the tables.
+        eventfd_read(task_event, &pending);
+        remove_dead();
+      } else if (fd == read_timer) {
+        write_log(LOG_ERR, "Monitor: Server has gone quiet, assuming it's gone...\n");
+        return NOTGIOS_SOCKET_CLOSED;
+      } else if (fd == socket) {
+        if (events[i].events & EPOLLOUT) {
+          // Socket has room again. Once we're under the low watermark, let reports flow again.
+          if (flush_outbound() < 0) return NOTGIOS_SOCKET_CLOSED;
+          if (throttled && outbound.len <= NOTGIOS_OUTBUF_LOW) {
+            write_log(LOG_DEBUG, "Monitor: Outbound buffer drained, resuming reports...\n");
+            throttled = 0;
+            send_reports();
           }
-        } else {
-          // The command we were sent is over the max size limit.
-          // Could dynamically allocate memory, but, since we're taking input from the user for this, there should
-          // be some sane upper limit to the command size anyways, in case they manage to slip something clever in,
-          // so this will indicate that possibility.
-          sprintf(buffer, "NGS NACK\nCAUSE COMMAND_TOO_LONG\n\n");
+          if (events[i].events == EPOLLOUT) continue;
         }
 
-        // Write our reply.
-        handle_write(socket, buffer);
-
-        // Check the report queue for entries and send them if they exist.
-        // This should probably be handled by a dedicated thread, but having two threads writing into the same socket
-        // is almost impossible to get right, and having two sockets requires significantly more error handling.
-        // Either way, due to the keepalive, except in exceptional circumstances when we wouldn't be able to write
-        // data anyways, this is gauranteed to be run at least once every 10 seconds.
-        send_reports(socket);
+        if (framer_fill(&inbound, socket) < 0) {
+          write_log(LOG_ERR, "Monitor: Error reading from socket...\n");
+          return NOTGIOS_SOCKET_CLOSED;
+        }
+        arm_read_timer();
+        if (handle_frames(buffer) == NOTGIOS_SOCKET_CLOSED) return NOTGIOS_SUCCESS;
 
         // If any tasks encountered unrecoverable errors, a message has already been sent to the front end, so remove
         // the task from the tables.
         remove_dead();
-      } else {
-        write_log(LOG_ERR, "Monitor: Error reading from socket...\n");
-        break;
       }
     }
+  }
+  return NOTGIOS_IN_SHUTDOWN;
+}
 
-    // Either our socket has been unexpectedly closed (server crashed), we received an orderly
-    // shutdown message from the server (server was interrupted by user, or machine server was
-    // running on was shutdown), or we received a SIGTERM.
-    // If the socket closed or the serve shutdown, we need to start buffering output and attempting to
-    // reopen the connection with the server.
-    // If we received a SIGTERM, we need to stop all tasks and shutdown.
-    if (exiting) {
-      write_log(LOG_INFO, "Monitor: Shutdown was initiated. Killing tasks...\n");
-
-      // FIXME: Need to handle the possibility of user sending us a SIGTERM for the hell of it, leaving the child running,
-      // causing the keepalive logic to fail when we come back up.
-      char **tasks = hash_keys(&threads);
-      for (char **current = tasks, *task_id = *current; current - tasks < threads.count; current++, task_id = *current) {
-        pthread_t *thread = hash_get(&threads, task_id);
-        thread_control_t *control = hash_get(&controls, task_id);
-
-        // Synchronize and set exit flag.
-        pthread_mutex_lock(&control->mutex);
-        control->paused = 0;
-        control->killed = 1;
-        pthread_cond_signal(&control->signal);
-        pthread_mutex_unlock(&control->mutex);
-
-        // Join with task thread.
-        pthread_join(*thread, NULL);
-        write_log(LOG_INFO, "Monitor: Killed a task...\n");
-      }
-      write_log(LOG_INFO, "Monitor: Tasks have exited, proceeding to shutdown...\n");
-      free(tasks);
-      destroy_hash(&threads);
-      destroy_hash(&controls);
-      destroy_hash(&children);
-      handle_write(socket, "NGS BYE\n\n");
+// Function answers every complete frame sitting in the inbound buffer, in order. Server
+// is free to pipeline commands, so a single read can hold any number of them.
+// Returns NOTGIOS_SOCKET_CLOSED if the server is saying goodbye.
+int handle_frames(char *buffer) {
+  int retval;
+  while (!exiting && (retval = framer_next(&inbound, buffer, NOTGIOS_FRAME_BUFSIZE)) != FRAMER_EMPTY) {
+    if (retval == FRAMER_TOOBIG) {
+      write_log(LOG_ERR, "Monitor: Received an oversized message, discarding...\n");
+      sprintf(buffer, "NGS NACK\nCAUSE COMMAND_TOO_LONG\n\n");
+    } else if (handle_command(buffer) == NOTGIOS_SOCKET_CLOSED) {
+      return NOTGIOS_SOCKET_CLOSED;
     }
 
+    // Write our reply. If the socket's gone, the event loop finds out on its next pass.
+    if (send_message(buffer) < 0) write_log(LOG_ERR, "Monitor: Failed to send a reply...\n");
+  }
+  return NOTGIOS_SUCCESS;
+}
+
+// Function figures out what the server wants, and does it. Reply is written back into buffer.
+// Returns NOTGIOS_SOCKET_CLOSED if the server is saying goodbye.
+int handle_command(char *buffer) {
+  char *commands[NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS];
+
+  // Batches are the only thing allowed to be bigger than a regular command, and have a
+  // layout of their own.
+  if (strstr(buffer, "NGS JOB ADD BATCH\n") == buffer) {
+    write_log(LOG_INFO, "Monitor: Received a batch add message...\n");
+    char *reply = malloc(sizeof(char) * NOTGIOS_FRAME_BUFSIZE);
+    if (reply) {
+      handle_batch(buffer, reply, NOTGIOS_FRAME_BUFSIZE);
+      strcpy(buffer, reply);
+      free(reply);
+    } else {
+      sprintf(buffer, "NGS NACK\nCAUSE NO_MEMORY\n\n");
+    }
+    return NOTGIOS_SUCCESS;
+  }
+
+  if (strlen(buffer) < NOTGIOS_STATIC_BUFSIZE && !parse_commands(commands, buffer)) {
+    char *cmd = commands[0];
+    if (strstr(cmd, "NGS JOB ADD") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received an add message...\n");
+      handle_add(commands, buffer);
+    } else if (strstr(cmd, "NGS JOB PAUS") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received a pause message...\n");
+      handle_reschedule(commands[1], buffer, PAUSE);
+    } else if (strstr(cmd, "NGS JOB RES") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received a resume message...\n");
+      handle_reschedule(commands[1], buffer, RESUME);
+    } else if (strstr(cmd, "NGS JOB DEL") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received a delete message...\n");
+      handle_reschedule(commands[1], buffer, DELETE);
+    } else if (strstr(cmd, "NGS STILL THERE?") == cmd) {
+      // Manual keepalive. I know TCP is supposed to do stuff like this on its own, but honestly it makes
+      // it easier on my end to detect errors if I also do it manually.
+      // Servers that understand sessions also tell us how far along in our reports they are.
+      unsigned long acked;
+      write_log(LOG_INFO, "Monitor: Received keepalive message...\n");
+      if (commands[1] && sscanf(commands[1], "ACKED %lu", &acked) == 1) ack_reports(acked);
+      sprintf(buffer, "NGS STILL HERE!\n\n");
+    } else if (strstr(cmd, "NGS STATS") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received a stats message...\n");
+      handle_stats(buffer, NOTGIOS_FRAME_BUFSIZE);
+    } else if (strstr(cmd, "NGS TRACE") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received a trace message...\n");
+      handle_trace(buffer, NOTGIOS_FRAME_BUFSIZE);
+    } else if (strstr(cmd, "NGS LOG LEVEL") == cmd) {
+      write_log(LOG_INFO, "Monitor: Received a log level message...\n");
+      handle_log_level(commands[1], buffer);
+    } else if (strstr(cmd, "NGS BYE") == cmd) {
+      write_log(LOG_INFO, "Monitor: Server send a shutdown message, beginning reconnect procedures...\n");
+      return NOTGIOS_SOCKET_CLOSED;
+    } else if (exiting) {
+      sprintf(buffer, "NGS NACK\nCAUSE SHUTDOWN\n\n");
+    } else {
+      // Shouldn't happen, but hey, everything that isn't supposed to happen eventually does, so there.
+      write_log(LOG_ERR, "Monitor: Received an invalid message, discarding...\n");
+      sprintf(buffer, "NGS NACK\nCAUSE UNRECOGNIZED_COMMAND\n\n");
+    }
+  } else {
+    // The command we were sent is over the max size limit.
+    // Could dynamically allocate memory, but, since we're taking input from the user for this, there should
+    // be some sane upper limit to the command size anyways, in case they manage to slip something clever in,
+    // so this will indicate that possibility.
+    sprintf(buffer, "NGS NACK\nCAUSE COMMAND_TOO_LONG\n\n");
+  }
+  return NOTGIOS_SUCCESS;
+}
+
+// Function stops all tasks, says goodbye to the server if we're connected, and makes sure
+// anything we haven't sent yet is on disk. Returns the exit status for main.
+int shutdown_monitor(int socket) {
+  write_log(LOG_INFO, "Monitor: Shutdown was initiated. Killing tasks...\n");
+
+  // FIXME: Need to handle the possibility of user sending us a SIGTERM for the hell of it, leaving the child running,
+  // causing the keepalive logic to fail when we come back up.
+  // Tasks hold their lock for as long as they're collecting, and with schedules spread out
+  // some of them always are, so tell everyone first, and only then wait on anyone. Tasks
+  // that are sleeping still need to be woken up under their lock below.
+  int cursor = 0;
+  task_t *task;
+  while ((task = slotmap_next(&tasks, &cursor))) __atomic_store_n(&task->control.killed, 1, __ATOMIC_RELAXED);
+
+  cursor = 0;
+  while ((task = slotmap_next(&tasks, &cursor))) {
+    thread_control_t *control = &task->control;
+
+    // Synchronize and set exit flag.
+    pthread_mutex_lock(&control->mutex);
+    control->paused = 0;
+    control->killed = 1;
+    pthread_cond_signal(&control->signal);
+    pthread_mutex_unlock(&control->mutex);
+
+    // Join with task thread.
+    pthread_join(task->thread, NULL);
+    write_log(LOG_INFO, "Monitor: Killed a task...\n");
+  }
+  write_log(LOG_INFO, "Monitor: Tasks have exited, proceeding to shutdown...\n");
+  write_log(LOG_INFO, "Monitor: Report queue made %ld allocations out of %ld slabs...\n", reports.nodes.allocs, reports.nodes.grows);
+  destroy_slotmap(&tasks);
+  destroy_trace();
+
+  if (socket >= 0) {
+    // Give whatever is still queued up a chance to make it out before we say goodbye.
+    send_message("NGS BYE\n\n");
+    drain_outbound(NOTGIOS_WRITE_TIMEOUT);
     close(socket);
-    close(server_socket);
-    if (exiting) return EXIT_SUCCESS;
   }
+  __atomic_store_n(&connected, 0, __ATOMIC_SEQ_CST);
+  connection = -1;
+  spool_reports();
+  if (spooling) destroy_spool(&spool);
+  destroy_framer(&inbound);
+  destroy_outbuf(&outbound);
+  ack_reports(next_seq);
+  free(unacked);
+  return EXIT_SUCCESS;
 }
 
 void *launch_worker_thread(void *voidargs) {
   // Parse out all of the relevant arguments.
-  thread_args_t *args = voidargs;
-  struct timespec time;
-  char *id = args->id;
-  int freq = args->freq;
-  task_type_t type = args->type;
-  metric_type_t metric = args->metric;
-  thread_control_t *control = args->control;
-  task_option_t *options = args->options;
+  task_t *task = voidargs;
+  struct timespec deadline, now, finished;
+  char *id = task->args.id;
+  task_type_t type = task->args.type;
+  thread_control_t *control = task->args.control;
 
   // Update stats to reflect task creation.
   increment_stats(type, id);
+  char name[TRACE_MAX_NAME_LEN];
+  snprintf(name, TRACE_MAX_NAME_LEN, "task %s", id);
+  trace_thread(name);
 
   // Spin and collect data until we're killed.
   write_log(LOG_INFO, "Task %s: Successfully launched!\n", id);
+  schedule_first(&deadline, task->sampler.interval_ms, task->args.key);
   pthread_mutex_lock(&control->mutex);
   while (!control->killed) {
-    // Check if we've been paused, and sleep until we're rescheduled if so.
-    if (control->paused) pthread_cond_wait(&control->signal, &control->mutex);
+    // Check if we've been paused, and sleep until we're rescheduled if so. Slots that went
+    // by in the meantime weren't missed, so pick the schedule back up from here.
+    if (control->paused) {
+      pthread_cond_wait(&control->signal, &control->mutex);
+      schedule_first(&deadline, task->sampler.interval_ms, task->args.key);
+      continue;
+    }
+
+    // Sleep until either it's time to collect data or we've been rescheduled, and then
+    // check everything over again, since either one can happen at any time.
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec < deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec < deadline.tv_nsec)) {
+      pthread_cond_timedwait(&control->signal, &control->mutex, &deadline);
+      continue;
+    }
+    task_timing_t *timing = __atomic_load_n(&task->timing, __ATOMIC_ACQUIRE);
+    record_timing(timing ? &timing->lateness : NULL, &task_stats.lateness[type], &deadline, &now);
 
-    // Make the magic happen.
-    int retval = run_task(type, metric, options, id);
+    // Make the magic happen, and keep track of how long it took.
+    trace_event("collect", TRACE_BEGIN, task->args.key);
+    int retval = run_task(task);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    trace_event("collect", TRACE_END, task->args.key);
+    record_timing(timing ? &timing->collect : NULL, &task_stats.collect[type], &now, &finished);
 
     // Check error conditions.
     if (retval == NOTGIOS_TASK_FATAL) {
@@ -366,6 +670,7 @@ void *launch_worker_thread(void *voidargs) {
       write_log(LOG_ERR, "Task %s: Encountered a fatal error, exiting...\n", id);
       control->dropped = 1;
       pthread_mutex_unlock(&control->mutex);
+      eventfd_write(task_event, 1);
 
       // Update stats to reflect task removal.
       decrement_stats(type, id);
@@ -376,6 +681,7 @@ void *launch_worker_thread(void *voidargs) {
       write_log(LOG_ERR, "Task %s: Initialization of task appears invalid, exiting...\n", id);
       control->dropped = 1;
       pthread_mutex_unlock(&control->mutex);
+      eventfd_write(task_event, 1);
 
       // Update stats to reflect task removal.
       decrement_stats(type, id);
@@ -383,15 +689,14 @@ void *launch_worker_thread(void *voidargs) {
     }
     write_log(LOG_INFO, "Task %s: Finished collecting data...\n", id);
 
-    // pthread_cond_timewait takes an absolute time to sleep until. Seems kind of silly to me,
-    // but we have to deal with it.
-    // FIXME: Apparently this function was added to POSIX recently enough to not be portable.
-    // Need to replace with clock function. Fails to compile on CentOS 6.6.
-    clock_gettime(CLOCK_REALTIME, &time);
-    time.tv_sec += freq;
-
-    // Sleep until either it's time to collect data again or we've been rescheduled.
-    pthread_cond_timedwait(&control->signal, &control->mutex, &time);
+    // Move on to the next slot in the schedule. Collecting doesn't push the schedule back,
+    // but if it took longer than a period, the slots we missed are skipped, not made up.
+    long missed = schedule_next(&deadline, task->sampler.interval_ms, &finished);
+    if (missed) {
+      write_log(LOG_DEBUG, "Task %s: Overran its schedule, skipped %ld collections...\n", id, missed);
+      __atomic_add_fetch(&task->missed, missed, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&task_stats.missed[type], missed, __ATOMIC_RELAXED);
+    }
   }
   pthread_mutex_unlock(&control->mutex);
 
@@ -403,16 +708,120 @@ void *launch_worker_thread(void *voidargs) {
 
 // Function takes care of adding a task.
 void handle_add(char **commands, char *reply_buf) {
-  int freq;
+  thread_args_t *arguments = calloc(1, sizeof(thread_args_t));
+  char *cause = parse_task(commands, arguments);
+  if (cause) {
+    free(arguments);
+    RETURN_NACK(reply_buf, cause);
+  }
+
+  cause = start_task(arguments);
+  if (cause) RETURN_NACK(reply_buf, cause);
+
+  // Write acknowledgement.
+  RETURN_ACK(reply_buf);
+}
+
+// Function takes care of adding many tasks at once. Each task in the frame is laid out
+// exactly like a regular add, minus the first line, and is closed off by an END line.
+// Every task is validated before any of them are started, and the reply carries one
+// ACK or NACK per task, in the order they were sent, for as many tasks as fit. COUNT says
+// how many that was.
+void handle_batch(char *frame, char *reply_buf, int reply_len) {
+  int num_tasks = 0, offset = 0;
+  char *save, *line = strtok_r(frame, "\n", &save);
+
+  // Count the tasks so we know how much space we need.
+  for (char *end = save; (end = strstr(end, "\nEND\n")); end++) num_tasks++;
+  if (!strncmp(save, "END\n", 4)) num_tasks++;
+  if (!num_tasks) RETURN_NACK(reply_buf, "EMPTY_BATCH");
+
+  thread_args_t **batch = calloc(num_tasks, sizeof(thread_args_t *));
+  char **causes = calloc(num_tasks, sizeof(char *));
+  if (!batch || !causes) {
+    free(batch);
+    free(causes);
+    RETURN_NACK(reply_buf, "NO_MEMORY");
+  }
+
+  // Validate everything first.
+  for (int i = 0; i < num_tasks; i++) {
+    char *commands[NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS];
+    int elem = 1;
+    memset(commands, 0, sizeof(commands));
+    commands[0] = "NGS JOB ADD";
+
+    while ((line = strtok_r(NULL, "\n", &save)) && strcmp(line, "END")) {
+      if (elem < NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS) commands[elem] = line;
+      elem++;
+    }
+
+    // Big batches are when we're most likely to run short, so keep going and NACK whatever
+    // we couldn't make room for.
+    batch[i] = calloc(1, sizeof(thread_args_t));
+    if (!batch[i]) causes[i] = "NO_MEMORY";
+    else if (elem > NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS) causes[i] = "TOO_MANY_OPTIONS";
+    else causes[i] = parse_task(commands, batch[i]);
+  }
+  write_log(LOG_DEBUG, "Monitor: Finished validating a batch of %d tasks. Starting them...\n", num_tasks);
+
+  // Start everything that made it through, and build the reply vector as we go. Lines are
+  // written in behind room for the header, since COUNT isn't known until the end. A task
+  // whose line might not fit isn't started, and nothing after it is either, so the server
+  // can safely send again whatever it didn't hear back about.
+  char *lines = reply_buf + NOTGIOS_BATCH_LINE_LEN;
+  int answered = 0, room = reply_len - NOTGIOS_BATCH_LINE_LEN - NOTGIOS_SMALL_BUFSIZE;
+  for (int i = 0; i < num_tasks; i++) {
+    if (room - offset < NOTGIOS_BATCH_LINE_LEN) {
+      free(batch[i]);
+      continue;
+    }
+    char id[NOTGIOS_MAX_NUM_LEN];
+    strcpy(id, batch[i] && batch[i]->id[0] ? batch[i]->id : "?");
+
+    // start_task owns the arguments from here on, even if it fails.
+    if (!causes[i]) causes[i] = start_task(batch[i]);
+    else free(batch[i]);
+
+    if (causes[i]) offset += sprintf(lines + offset, "ID %s NACK %s\n", id, causes[i]);
+    else offset += sprintf(lines + offset, "ID %s ACK\n", id);
+    answered++;
+  }
+  if (answered < num_tasks) {
+    write_log(LOG_ERR, "Monitor: Batch reply is full, left %d tasks unstarted...\n", num_tasks - answered);
+  }
+
+  int header = sprintf(reply_buf, "NGS BATCH REPLY\nCOUNT %d\n", answered);
+  memmove(reply_buf + header, lines, offset);
+  offset += header;
+  if (answered < num_tasks) offset += sprintf(reply_buf + offset, "TRUNCATED\n");
+  strcpy(reply_buf + offset, "\n");
+
+  free(batch);
+  free(causes);
+}
+
+// Function turns the lines of an add command into the arguments for a task.
+// Returns NULL if everything checks out, or the cause to NACK with if not.
+char *parse_task(char **commands, thread_args_t *arguments) {
+  double freq;
   char type_str[NOTGIOS_MAX_TYPE_LEN], metric_str[NOTGIOS_MAX_METRIC_LEN], id[NOTGIOS_MAX_NUM_LEN];
   task_type_t type;
   metric_type_t metric;
 
   // Pull out the parameters.
-  sscanf(commands[1], "ID %s", id);
-  sscanf(commands[2], "TYPE %s", type_str);
-  sscanf(commands[3], "METRIC %s", metric_str);
-  sscanf(commands[4], "FREQ %d", &freq);
+  for (int i = 1; i < NOTGIOS_REQUIRED_COMMANDS; i++) {
+    if (!commands[i]) return "MALFORMED_TASK";
+  }
+  if (sscanf(commands[1], "ID %11s", id) != 1) return "MALFORMED_TASK";
+  strcpy(arguments->id, id);
+  if (parse_task_key(id, &arguments->key) != NOTGIOS_SUCCESS) return "MALFORMED_TASK";
+  if (sscanf(commands[2], "TYPE %15s", type_str) != 1) return "UNRECOGNIZED_TYPE";
+  if (sscanf(commands[3], "METRIC %7s", metric_str) != 1) return "UNRECOGNIZED_METRIC";
+
+  // Frequency is in seconds, and can be fractional, down to the millisecond.
+  if (sscanf(commands[4], "FREQ %lf", &freq) != 1) return "MALFORMED_TASK";
+  if (!(freq >= NOTGIOS_MIN_FREQ_MS / 1000.0 && freq <= NOTGIOS_MAX_FREQ_MS / 1000.0)) return "BAD_FREQ";
 
   // "Convert" from string to enum value.
   if (!strcmp(type_str, "PROCESS")) type = PROCESS;
@@ -421,127 +830,156 @@ void handle_add(char **commands, char *reply_buf) {
   else if (!strcmp(type_str, "SWAP")) type = SWAP;
   else if (!strcmp(type_str, "LOAD")) type = LOAD;
   else if (!strcmp(type_str, "TOTAL")) type = TOTAL;
-  else RETURN_NACK(reply_buf, "UNRECOGNIZED_TYPE");
+  else if (!strcmp(type_str, "SELF")) type = SELF;
+  else return "UNRECOGNIZED_TYPE";
 
   // "Convert" from string to enum value.
   if (!strcmp(metric_str, "MEMORY")) metric = MEMORY;
   else if (!strcmp(metric_str, "CPU")) metric = CPU;
   else if (!strcmp(metric_str, "IO")) metric = IO;
   else if (!strcmp(metric_str, "NONE")) metric = NONE;
-  else RETURN_NACK(reply_buf, "UNRECOGNIZED_METRIC");
+  else return "UNRECOGNIZED_METRIC";
 
   // This shouldn't happen, but would mean that the server sent us a duplicate ID.
-  if (hash_get(&threads, id) != NULL) RETURN_NACK(reply_buf, "DUPLICATE_ID");
+  if (slotmap_get(&tasks, arguments->key) != NULL) return "DUPLICATE_ID";
 
   // Get information ready to pass onto the thread.
-  thread_args_t *arguments = calloc(1, sizeof(thread_args_t));
-  strcpy(arguments->id, id);
-  arguments->freq = freq;
+  arguments->freq_ms = (int) (freq * 1000 + 0.5);
   arguments->type = type;
   arguments->metric = metric;
 
   // Look over rest of commands if applicable.
   // God this is ugly, but it's the best I can come up with.
-  if (type == PROCESS || type == DIRECTORY || type == DISK) {
-    int elem = 0;
-
-    // Declare arrays so that the indexes of each correspond with each other.
-    char *option_strings[] = {
-      "KEEPALIVE",
-      "PIDFILE",
-      "RUNCMD",
-      "PATH",
-      "MNTPNT"
-    };
-    task_option_type_t options[] = {
-      KEEPALIVE,
-      PIDFILE,
-      RUNCMD,
-      PATH,
-      MNTPNT
-    };
-    task_type_t option_categories[] = {
-      PROCESS,
-      PROCESS,
-      PROCESS,
-      DIRECTORY,
-      DISK
-    };
-    int num_options = sizeof(option_strings) / sizeof(option_strings[0]);
-
-    for (int i = 5; commands[i] && i < 5 + NOTGIOS_MAX_OPTIONS; i++) {
-      int found = 0;
-      char *cmd = commands[i];
-
-      for (int j = 0; j < num_options; j++) {
-        char *option_type = option_strings[j];
-
-        // Figure out which option we're using.
-        if (strstr(cmd, option_type) == cmd) {
-          // Check that the option applies to this type of task.
-          if (type != option_categories[j]) {
-            free(arguments);
-            RETURN_NACK(reply_buf, "INAPPLICABLE_OPTION");
-          }
-          found = 1;
-
-          // Everything is kosher. Assign the enum and copy over the parameter from the command.
-          task_option_t option;
-          memset(&option, 0, sizeof(task_option_t));
-          int option_len = strlen(option_type), cmd_len = strlen(cmd);
-          char *copy_start = cmd + option_len + 1;
-          int copy_len = cmd_len - option_len;
-
-          option.type = options[j];
-          memcpy(&option.value, copy_start, copy_len);
-          arguments->options[elem++] = option;
-        }
-      }
+  int elem = 0;
+
+  // Declare arrays so that the indexes of each correspond with each other.
+  char *option_strings[] = {
+    "KEEPALIVE",
+    "PIDFILE",
+    "RUNCMD",
+    "PATH",
+    "MNTPNT"
+  };
+  task_option_type_t options[] = {
+    KEEPALIVE,
+    PIDFILE,
+    RUNCMD,
+    PATH,
+    MNTPNT
+  };
+  task_type_t option_categories[] = {
+    PROCESS,
+    PROCESS,
+    PROCESS,
+    DIRECTORY,
+    DISK
+  };
+  int num_options = sizeof(option_strings) / sizeof(option_strings[0]);
+
+  for (int i = 5; i < 5 + NOTGIOS_MAX_OPTIONS && commands[i]; i++) {
+    int found = 0;
+    char *cmd = commands[i];
+
+    // Options that shape how a task samples apply to every type.
+    if (strstr(cmd, "ADAPTIVE ") == cmd) {
+      char *cause = parse_adaptive(cmd + strlen("ADAPTIVE "), &arguments->adaptive);
+      if (cause) return cause;
+      continue;
+    } else if (strstr(cmd, "DEADBAND ") == cmd) {
+      char *cause = parse_deadband(cmd + strlen("DEADBAND "), &arguments->deadband);
+      if (cause) return cause;
+      continue;
+    } else if (strstr(cmd, "WINDOW ") == cmd) {
+      char *cause = parse_window(cmd + strlen("WINDOW "), &arguments->window_ms);
+      if (cause) return cause;
+      continue;
+    } else if (strstr(cmd, "ALARM ") == cmd) {
+      char *cause = parse_alarm(cmd + strlen("ALARM "), &arguments->alarm);
+      if (cause) return cause;
+      continue;
+    }
 
-      if (!found) {
-        // Our option was never found! We've been given an invalid option.
-        // Should never happen.
-        free(arguments);
-        RETURN_NACK(reply_buf, "UNRECOGNIZED_OPTION");
+    for (int j = 0; j < num_options; j++) {
+      char *option_type = option_strings[j];
+
+      // Figure out which option we're using.
+      if (strstr(cmd, option_type) == cmd) {
+        // Check that the option applies to this type of task.
+        if (type != option_categories[j]) return "INAPPLICABLE_OPTION";
+        found = 1;
+
+        // Everything is kosher. Assign the enum and copy over the parameter from the command.
+        task_option_t option;
+        memset(&option, 0, sizeof(task_option_t));
+        int option_len = strlen(option_type), cmd_len = strlen(cmd);
+        char *copy_start = cmd + option_len + 1;
+        int copy_len = cmd_len - option_len;
+        if (copy_len > NOTGIOS_MAX_OPTION_LEN) return "OPTION_TOO_LONG";
+
+        option.type = options[j];
+        memcpy(&option.value, copy_start, copy_len);
+        arguments->options[elem++] = option;
       }
     }
-  }
-  write_log(LOG_DEBUG, "Monitor: Finished parsing options. Starting the task...\n");
 
-  // Create a control struct for the thread.
-  thread_control_t *control = create_thread_control();
-  arguments->control = control;
+    // Our option was never found! We've been given an invalid option.
+    // Should never happen.
+    if (!found) return "UNRECOGNIZED_OPTION";
+  }
+  write_log(LOG_DEBUG, "Monitor: Finished parsing options for task %s...\n", id);
+  return NULL;
+}
 
-  // Create a new thread to run the task!
-  pthread_t *task = malloc(sizeof(pthread_t));
-  pthread_create(task, NULL, launch_worker_thread, arguments);
+// Function starts up a task that has already made it through parse_task. Takes ownership
+// of arguments.
+// Returns NULL if the task is running, or the cause to NACK with if not.
+char *start_task(thread_args_t *arguments) {
+  task_t *task;
+
+  // Batches aren't checked against themselves during validation, so the table has the
+  // final say on duplicates.
+  int retval = slotmap_put(&tasks, arguments->key, (void **) &task);
+  if (retval != SLOTMAP_SUCCESS) {
+    free(arguments);
+    if (retval == SLOTMAP_EXISTS) return "DUPLICATE_ID";
+    else if (retval == SLOTMAP_FROZEN) return "SHUTDOWN";
+    else return "NO_MEMORY";
+  }
 
-  // Add our new thread and its controls.
-  int retvals[2];
-  retvals[0] = hash_put(&threads, id, task);
-  retvals[1] = hash_put(&controls, id, control);
+  // Everything the thread needs lives in its table entry from here on.
+  task->args = *arguments;
+  free(arguments);
+  init_thread_control(&task->control);
+  init_self_probe(&task->self);
+  task->args.control = &task->control;
+  if (init_sampler(&task->sampler, &task->args) != NOTGIOS_SUCCESS || (timing_tasks && !(task->timing = create_task_timing()))) {
+    slotmap_drop(&tasks, task->args.key);
+    return "NO_MEMORY";
+  }
 
-  if (retvals[0] == HASH_FROZEN || retvals[1] == HASH_FROZEN) {
-    // This can only happen if we've received a SIGTERM.
-    RETURN_NACK(reply_buf, "SHUTDOWN");
+  // Create a new thread to run the task!
+  trace_event("dispatch", TRACE_INSTANT, task->args.key);
+  if (pthread_create(&task->thread, NULL, launch_worker_thread, task)) {
+    slotmap_drop(&tasks, task->args.key);
+    return "NO_RESOURCES";
   }
-  // Write acknowledgement.
-  RETURN_ACK(reply_buf);
+  return NULL;
 }
 
 // Function handles pausing, resuming, and deleting tasks.
 void handle_reschedule(char *cmd, char *reply_buf, task_action_t action) {
   char id_str[NOTGIOS_MAX_NUM_LEN];
-  thread_control_t *control;
-  pthread_t *task;
+  uint64_t key;
+  task_t *task = NULL;
 
   // Get task to reschedule.
   memset(id_str, 0, sizeof(char) * NOTGIOS_MAX_NUM_LEN);
-  sscanf(cmd, "ID %s", id_str);
-  control = hash_get(&controls, id_str);
+  sscanf(cmd, "ID %11s", id_str);
+  if (parse_task_key(id_str, &key) == NOTGIOS_SUCCESS) task = slotmap_get(&tasks, key);
 
   // This shouldn't happen, but would mean the server sent us a request for a nonexistent ID.
-  if (!control) RETURN_NACK(reply_buf, "NO_SUCH_ID");
+  if (!task) RETURN_NACK(reply_buf, "NO_SUCH_ID");
+  thread_control_t *control = &task->control;
 
   // Synchronize threads and set status.
   pthread_mutex_lock(&control->mutex);
@@ -560,14 +998,10 @@ void handle_reschedule(char *cmd, char *reply_buf, task_action_t action) {
   pthread_mutex_unlock(&control->mutex);
 
   if (action == DELETE) {
-    int retvals[2];
-    task = hash_get(&threads, id_str);
-    pthread_join(*task, NULL);
-    retvals[0] = hash_drop(&threads, id_str);
-    retvals[1] = hash_drop(&controls, id_str);
+    pthread_join(task->thread, NULL);
 
     // This can only happen if we've received a SIGTERM.
-    if (retvals[0] == HASH_FROZEN || retvals[1] == HASH_FROZEN) RETURN_NACK(reply_buf, "SHUTDOWN");
+    if (slotmap_drop(&tasks, key) == SLOTMAP_FROZEN) RETURN_NACK(reply_buf, "SHUTDOWN");
   }
 
   // Write acknowledgement.
@@ -575,114 +1009,548 @@ void handle_reschedule(char *cmd, char *reply_buf, task_action_t action) {
   RETURN_ACK(reply_buf);
 }
 
-void handle_signal(int signo) {
-  if (signo == SIGCHLD) handle_child();
-  else if (signo == SIGTERM) handle_term();
+// Function reports everything the monitor knows about its own performance: totals first,
+// then a line per task type, then a line per task, for as many tasks as fit. Times are all
+// in microseconds. Tasks only keep timings of their own once stats have been asked for, so
+// the first reply's task lines start out empty.
+void handle_stats(char *reply_buf, int reply_len) {
+  char *type_names[] = {"NONE", "PROCESS", "DIRECTORY", "DISK", "SWAP", "LOAD", "TOTAL", "SELF"};
+  start_task_timing();
+
+  // Leave room for the closing newline, and a line saying we ran out of room.
+  int len = reply_len - NOTGIOS_SMALL_BUFSIZE;
+  int offset = snprintf(reply_buf, len, "NGS STATS REPLY\nTASKS %d\nQUEUE DEPTH %d\nSPOOLED %ld\n",
+      __atomic_load_n(&task_stats.num_tasks, __ATOMIC_RELAXED), reports.count, spooling ? spool.count : 0);
+  offset += snprintf(reply_buf + offset, len - offset,
+      "BYTES SENT %ld\nREPORTS SENT %ld\nALARMS SENT %ld\nRECONNECTS %ld\nDROPPED %ld\nSUPPRESSED %ld\n",
+      outbound.written, task_stats.reports_sent, task_stats.alarms_sent, task_stats.reconnects,
+      __atomic_load_n(&task_stats.dropped, __ATOMIC_RELAXED), __atomic_load_n(&task_stats.suppressed, __ATOMIC_RELAXED));
+
+  // Queue nodes come out of slabs, so once the queues reach their working size, ALLOCS keeps
+  // climbing while GROWS stays put.
+  list_t *queues[] = {&reports, &alarms};
+  char *queue_names[] = {"REPORT", "ALARM"};
+  for (int i = 0; i < 2; i++) {
+    slab_t *nodes = &queues[i]->nodes;
+    offset += snprintf(reply_buf + offset, len - offset, "SLAB %s ALLOCS %ld GROWS %ld LIVE %ld\n", queue_names[i],
+        __atomic_load_n(&nodes->allocs, __ATOMIC_RELAXED), __atomic_load_n(&nodes->grows, __ATOMIC_RELAXED),
+        __atomic_load_n(&nodes->live, __ATOMIC_RELAXED));
+  }
+
+  // Log messages that found their thread's ring full.
+  offset += snprintf(reply_buf + offset, len - offset, "LOG DROPPED %ld\n", logger_dropped());
+
+  for (int i = PROCESS; i < NOTGIOS_NUM_TYPES; i++) {
+    offset += snprintf(reply_buf + offset, len - offset, "TYPE %s TASKS %d ", type_names[i],
+        __atomic_load_n(&task_stats.num_by_type[i], __ATOMIC_RELAXED));
+    offset += format_histograms(reply_buf + offset, len - offset, &task_stats.collect[i], &task_stats.lateness[i],
+        __atomic_load_n(&task_stats.missed[i], __ATOMIC_RELAXED));
+  }
+
+  // We're the only thread that adds or removes tasks, so they'll all still be here when we
+  // look at them.
+  int cursor = 0;
+  task_t *task;
+  while ((task = slotmap_next(&tasks, &cursor)) && offset < len) {
+    int written = snprintf(reply_buf + offset, len - offset, "TASK %s ", task->args.id);
+    task_timing_t *timing = task->timing;
+    written += format_histograms(reply_buf + offset + written, len - offset - written, timing ? &timing->collect : NULL,
+        timing ? &timing->lateness : NULL, __atomic_load_n(&task->missed, __ATOMIC_RELAXED));
+    if (offset + written >= len) break;
+    offset += written;
+  }
+  if (task) offset += sprintf(reply_buf + offset, "TRUNCATED\n");
+  strcpy(reply_buf + offset, "\n");
+}
+
+// Function gives every task timings of its own from here on, the first time it's called.
+// Only ever called from the main thread, which is the only one adding tasks.
+void start_task_timing() {
+  if (timing_tasks) return;
+  timing_tasks = 1;
+
+  int cursor = 0;
+  task_t *task;
+  while ((task = slotmap_next(&tasks, &cursor))) {
+    if (!task->timing) __atomic_store_n(&task->timing, create_task_timing(), __ATOMIC_RELEASE);
+  }
+}
+
+task_timing_t *create_task_timing() {
+  task_timing_t *timing = malloc(sizeof(task_timing_t));
+  if (timing) {
+    init_histogram(&timing->collect);
+    init_histogram(&timing->lateness);
+  }
+  return timing;
+}
+
+// Function writes the numbers for a pair of collection and lateness histograms on one line,
+// along with how many scheduled collections were skipped. Returns the number of characters
+// it would have written, like snprintf.
+int format_histograms(char *buffer, int len, histogram_t *collect, histogram_t *lateness, long missed) {
+  if (len <= 0) return 0;
+  return snprintf(buffer, len, "RUNS %lu COLLECT %lu %lu %lu %lu LATE %lu %lu %lu MISSED %ld\n",
+      (unsigned long) histogram_total(collect),
+      (unsigned long) histogram_percentile(collect, 50),
+      (unsigned long) histogram_percentile(collect, 90),
+      (unsigned long) histogram_percentile(collect, 99),
+      (unsigned long) histogram_max(collect),
+      (unsigned long) histogram_percentile(lateness, 50),
+      (unsigned long) histogram_percentile(lateness, 99),
+      (unsigned long) histogram_max(lateness),
+      missed);
+}
+
+// Function handles any signals that have come in through the signalfd. Runs on the main
+// thread, so, unlike a real signal handler, can do whatever it needs to.
+void handle_signals() {
+  struct signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    if (info.ssi_signo == SIGCHLD) handle_child();
+    else if (info.ssi_signo == SIGTERM) handle_term();
+    else if (info.ssi_signo == SIGUSR1) dump_trace();
+  }
+}
+
+// Function sends back the trace as JSON, trimmed down to the newest events on each thread
+// if it's all too much for one frame.
+void handle_trace(char *reply_buf, int reply_len) {
+  if (!trace_path) RETURN_NACK(reply_buf, "TRACING_OFF");
+  int offset = sprintf(reply_buf, "NGS TRACE REPLY\n");
+
+  // Leave room for the blank line that ends the frame.
+  FILE *out = fmemopen(reply_buf + offset, reply_len - offset - 2, "w");
+  if (!out || trace_write(out, reply_len - offset - 3) != TRACE_SUCCESS) {
+    if (out) fclose(out);
+    sprintf(reply_buf, "NGS NACK\nCAUSE NO_MEMORY\n\n");
+    return;
+  }
+  offset += ftell(out);
+  fclose(out);
+  strcpy(reply_buf + offset, "\n\n");
+}
+
+// Function changes which messages get logged from here on.
+void handle_log_level(char *cmd, char *reply_buf) {
+  char *level_names[] = {"ERR", "WARNING", "NOTICE", "INFO", "DEBUG"};
+  int levels[] = {LOG_ERR, LOG_WARNING, LOG_NOTICE, LOG_INFO, LOG_DEBUG};
+  char level_str[NOTGIOS_SMALL_BUFSIZE];
+
+  if (!cmd || sscanf(cmd, "LEVEL %31s", level_str) != 1) RETURN_NACK(reply_buf, "MALFORMED_COMMAND");
+  for (unsigned int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    if (strcmp(level_str, level_names[i])) continue;
+    logger_set_level(levels[i]);
+    write_log(LOG_INFO, "Monitor: Now logging at level %s...\n", level_str);
+    RETURN_ACK(reply_buf);
+  }
+  RETURN_NACK(reply_buf, "UNRECOGNIZED_LEVEL");
+}
+
+// Function writes the whole trace out to trace_path, for whoever sent us a SIGUSR1.
+void dump_trace() {
+  if (!trace_path) {
+    write_log(LOG_ERR, "Monitor: Asked for a trace, but tracing is off. Start with -t to turn it on...\n");
+    return;
+  }
+  FILE *out = fopen(trace_path, "w");
+  if (!out) {
+    write_log(LOG_ERR, "Monitor: Failed to open %s to write a trace...\n", trace_path);
+    return;
+  }
+  if (trace_write(out, 0) != TRACE_SUCCESS) write_log(LOG_ERR, "Monitor: Failed to write a trace to %s...\n", trace_path);
+  else write_log(LOG_INFO, "Monitor: Wrote a trace to %s...\n", trace_path);
+  fclose(out);
 }
 
 void handle_term() {
-  // We're shutting down, so freeze the hashes so they can't be modified.
-  hash_freeze(&threads);
-  hash_freeze(&controls);
-  hash_freeze(&children);
+  // We're shutting down, so freeze the task table so it can't be modified.
+  slotmap_freeze(&tasks);
 
-  // Set the exiting flag.
+  // Set the exiting flag. The event loop, or whatever we're blocked on, notices this and
+  // unwinds back to main.
   exiting = 1;
+}
 
-  // FIXME: HACK ALERT!!!!
-  // I can't shut threads down or do anything complicated here, because I'm in a signal handler,
-  // so I need the main thread to notice and do it for me. Problem is, the main thread could be
-  // blocked on input from the server for up to 20 seconds. I like the current read behavior,
-  // so I can't really change that, so, instead I've set up a pipe that can be written to during
-  // shutdown for the sole purpose of forcing the select call in handle_read to return.
-  // It doesn't matter what's written, as long as something is, so this just spins until write
-  // reports that it's written at least one byte.
-  //
-  // If you have a better idea for how I could do this, shoot me an email at cfretz@icloud.com
-  int actual = 0;
-  while (!actual) actual += write(termpipe_in, "halt!", 6);
-}
-
-// Function handles removing dead children from the children hash so that they'll be restarted.
+// Function handles clearing dead children out of their tasks so that they'll be restarted.
 // TODO: Need to check exit status of child here to see if the exec failed.
 void handle_child() {
   int status = 0;
-  pid_t pid = waitpid((pid_t) -1, &status, WUNTRACED | WCONTINUED);
-
-  // Iterate across all of the current child processes to find the one we're being signaled about.
-  char **tasks = hash_keys(&children), *id = NULL;
-  for (char **current = tasks, *task_id = *current; current - tasks < children.count; current++, task_id = *current) {
-    uint16_t *tmp_pid = hash_get(&children, task_id);
-    if (*tmp_pid == pid) {
-      id = task_id;
-      break;
+  pid_t pid;
+
+  // Signals coalesce, so a single SIGCHLD can stand for any number of children.
+  while ((pid = waitpid((pid_t) -1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+    // Iterate across all of the current tasks to find the one whose child we're being signaled about.
+    int cursor = 0;
+    task_t *task;
+    while ((task = slotmap_next(&tasks, &cursor)) && __atomic_load_n(&task->child, __ATOMIC_ACQUIRE) != pid);
+
+    // This shouldn't happen, and I don't know what to do if it did, but I'll put this here for debugging purposes.
+    if (!task) {
+      write_log(LOG_ERR, "Monitor: Was sent a SIGCHLD, but can't find it???\n");
+      continue;
+    }
+
+    // Figure out what happened to the child and take appropriate action.
+    char *id = task->args.id;
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      write_log(LOG_INFO, "Child for task %s either crashed, exited, or was killed. Marking for restart...\n", id);
+      __atomic_store_n(&task->child, 0, __ATOMIC_RELEASE);
+    } else if (WIFSTOPPED(status)) {
+      // TODO: User might not want this, so need to make it configurable.
+      write_log(LOG_INFO, "Child for task %s was stopped, sending a SIGCONT...\n", id);
+      kill(pid, SIGCONT);
     }
   }
+}
 
-  // This shouldn't happen, and I don't know what to do if it did, but I'll put this here for debugging purposes.
-  if (!id) {
-    free(tasks);
-    write_log(LOG_ERR, "Monitor: Was sent a SIGCHLD, but can't find it???\n");
-    return;
+void send_reports() {
+  // Alarms go out ahead of everything, throttled or not, so how quickly they get to the
+  // server doesn't depend on how many reports are waiting.
+  if (send_alarms() != NOTGIOS_SUCCESS) return;
+
+  // Anything spooled while we were disconnected is older than what's in the queue, so it
+  // has to go out first.
+  if (check_throttle()) return;
+  if (spooling && spool.count > 0 && (drain_spool() != NOTGIOS_SUCCESS || spool.count > 0)) return;
+
+  while (reports.count > 0 && !throttled) {
+    task_report_t report;
+    char buffer[NOTGIOS_STATIC_BUFSIZE];
+    if (alarms.count > 0 && send_alarms() != NOTGIOS_SUCCESS) return;
+    if (rpop(&reports, &report) != LIST_SUCCESS) break;
+    trace_event("queue pop", TRACE_INSTANT, reports.count);
+
+    if (format_report(&report, buffer) == NOTGIOS_SUCCESS) {
+      // Send the report to the server.
+      // Reports aren't answered directly. Servers that understand sessions acknowledge them
+      // in bulk with their keepalives instead, and we hold on to them until then.
+      unsigned long seq = stamp_report(buffer);
+      int retval = send_message(buffer);
+      if (retval == NOTGIOS_NOT_QUEUED) {
+        // Report never made it out of our hands. Put it back at the front of the line, where
+        // it'll be spooled ahead of everything newer once we notice, and give its number back.
+        unstamp_report(seq);
+        rpush(&reports, &report);
+        return;
+      }
+
+      // Anything queued is on its way, even if the socket failed right behind it, so hold on
+      // to it and let it be resent under the same number.
+      retain_report(buffer, strlen(buffer), seq);
+      task_stats.reports_sent++;
+      if (retval < 0) return;
+      check_throttle();
+    }
   }
+}
+
+// Function sends every alarm that's waiting, oldest first. Alarms aren't spooled, they wait
+// in their own queue while we're disconnected, and go out first once we're back.
+int send_alarms() {
+  alarm_report_t alarm;
+  char buffer[NOTGIOS_STATIC_BUFSIZE];
 
-  // Figure out what happened to the child and take appropriate action.
-  if (WIFEXITED(status) || WIFSIGNALED(status)) {
-    write_log(LOG_INFO, "Child for task %s either crashed, exited, or was killed. Marking for restart...\n", id);
-    hash_drop(&children, id);
-  } else if (WIFSTOPPED(status)) {
-    // TODO: User might not want this, so need to make it configurable.
-    write_log(LOG_INFO, "Child for task %s was stopped, sending a SIGCONT...\n", id);
-    kill(pid, SIGCONT);
+  while (rpop(&alarms, &alarm) == LIST_SUCCESS) {
+    format_alarm(&alarm, buffer);
+    unsigned long seq = stamp_report(buffer);
+    int retval = send_message(buffer);
+    if (retval == NOTGIOS_NOT_QUEUED) {
+      // Put it back at the front of the line, so it still goes out before anything newer.
+      unstamp_report(seq);
+      rpush(&alarms, &alarm);
+      return NOTGIOS_SOCKET_CLOSED;
+    }
+    retain_report(buffer, strlen(buffer), seq);
+    task_stats.alarms_sent++;
+    if (retval < 0) return NOTGIOS_SOCKET_CLOSED;
   }
-  free(tasks);
+  return NOTGIOS_SUCCESS;
 }
 
-void send_reports(int socket) {
-  while (reports.count > 0) {
-    task_report_t report;
-    int retval = NOTGIOS_SUCCESS;
-    char buffer[NOTGIOS_STATIC_BUFSIZE], *start = "NGS JOB REPORT";
-    rpop(&reports, &report);
-
-    if (strlen(report.message) == 0) {
-      // Task is good.
-      switch (report.type) {
-        case PROCESS:
-          retval = handle_process_total_report(&report, start, buffer);
-          break;
-        case DIRECTORY:
-          retval = handle_directory_report(&report, start, buffer);
-          break;
-        case DISK:
-          retval = handle_disk_report(&report, start, buffer);
-          break;
-        case SWAP:
-          retval = handle_swap_report(&report, start, buffer);
-          break;
-        case LOAD:
-          retval = handle_load_report(&report, start, buffer);
-          break;
-        case TOTAL:
-          retval = handle_process_total_report(&report, start, buffer);
-          break;
-        default:
-          write_log(LOG_DEBUG, "Monitor: Found an invalid report while sending reports...\n");
-          retval = NOTGIOS_GENERIC_ERROR;
+// Function decides whether we can afford to hand the socket any more reports. Once the
+// server falls behind far enough to fill the outbound buffer past the high watermark, we
+// stop pulling reports until it drains back under the low watermark. In the meantime
+// workers keep pushing into the bounded report queue, whose drop policy does the rest.
+int check_throttle() {
+  if (!throttled && outbound.len >= NOTGIOS_OUTBUF_HIGH) {
+    write_log(LOG_DEBUG, "Monitor: Outbound buffer is full, holding reports...\n");
+    throttled = 1;
+  }
+  return throttled;
+}
+
+// Function sends everything in the spool to the server, oldest first. Reports are sent in
+// batches, one write per batch, and are only removed from the spool once written.
+int drain_spool() {
+  int num;
+  long sent = 0;
+  task_report_t batch[NOTGIOS_SPOOL_BATCH];
+  unsigned long seqs[NOTGIOS_SPOOL_BATCH];
+  char buffer[NOTGIOS_SPOOL_BATCH * NOTGIOS_STATIC_BUFSIZE], *frames[NOTGIOS_SPOOL_BATCH + 1];
+
+  while ((num = spool_peek(&spool, batch, NOTGIOS_SPOOL_BATCH)) > 0) {
+    int framed = 0;
+    frames[0] = buffer;
+    for (int i = 0; i < num; i++) {
+      if (format_report(&batch[i], frames[framed]) == NOTGIOS_SUCCESS) {
+        seqs[framed] = stamp_report(frames[framed]);
+        frames[framed + 1] = frames[framed] + strlen(frames[framed]);
+        framed++;
       }
-    } else {
-      // Task encountered an error.
-      long timestamp = report.time_taken;
-      sprintf(buffer, "%s\nID %s\nTIMESTAMP %ld\n%s\n\n", start, report.id, timestamp, report.message);
+    }
+    int retval = framed ? send_message(buffer) : NOTGIOS_SUCCESS;
+    if (retval == NOTGIOS_NOT_QUEUED) {
+      write_log(LOG_ERR, "Monitor: Lost connection while draining the spool...\n");
+      unstamp_report(seqs[0]);
+      return NOTGIOS_SOCKET_CLOSED;
+    }
+    for (int i = 0; i < framed; i++) retain_report(frames[i], frames[i + 1] - frames[i], seqs[i]);
+    task_stats.reports_sent += framed;
+    spool_advance(&spool, num);
+    sent += num;
+    if (retval < 0) {
+      write_log(LOG_ERR, "Monitor: Lost connection while draining the spool...\n");
+      return NOTGIOS_SOCKET_CLOSED;
     }
 
-    if (retval == NOTGIOS_SUCCESS) {
-      // Send the report to the server.
-      // FIXME: Currently does not expect an ACK after sending reports. Simplifies logic as this
-      // could otherwise potentially swallow keepalive messages or other things.
-      handle_write(socket, buffer);
+    // Spool can hold far more than the socket, so stop and let it catch up when needed.
+    if (check_throttle()) break;
+  }
+  if (sent) write_log(LOG_INFO, "Monitor: Sent %ld spooled reports...\n", sent);
+  return NOTGIOS_SUCCESS;
+}
+
+// Function moves anything left in the report queue into the spool once the connection is
+// gone, so it survives until we reconnect, or until we're restarted. Safe from any thread,
+// as the queue and the spool both have locks of their own.
+void spool_reports() {
+  task_report_t report;
+  if (!spooling) return;
+
+  while (rpop(&reports, &report) == LIST_SUCCESS) {
+    if (spool_append(&spool, &report) != SPOOL_SUCCESS) {
+      write_log(LOG_ERR, "Monitor: Spool is full, dropping report for task %s...\n", report.id);
+    }
+  }
+}
+
+// Function gives a formatted report the next sequence number, if we're in a session, so that
+// the server can tell us how far along it is, and skip anything it's already seen when we
+// resend after a reconnect. Returns the sequence number, or zero if there isn't one.
+unsigned long stamp_report(char *buffer) {
+  if (!session[0]) return 0;
+  unsigned long seq = next_seq++;
+  sprintf(buffer + strlen(buffer) - 1, "SEQ %lu\n\n", seq);
+  return seq;
+}
+
+// Function gives back the sequence numbers from seq on, for reports that were stamped but
+// never queued, so the server doesn't see a gap where they would have been.
+void unstamp_report(unsigned long seq) {
+  if (seq) next_seq = seq;
+}
+
+// Function holds on to a report that's been written to the socket until the server says
+// it has it. Retention is best effort, if the server goes long enough without
+// acknowledging anything the oldest reports are forgotten.
+void retain_report(char *frame, int len, unsigned long seq) {
+  if (!seq) return;
+
+  if (unacked_count == NOTGIOS_UNACKED_MAX) forget_report();
+  sent_report_t *slot = &unacked[(unacked_start + unacked_count++) % NOTGIOS_UNACKED_MAX];
+  char *copy = slot->frame;
+  slot->seq = seq;
+  if (len >= NOTGIOS_STATIC_BUFSIZE && !(copy = slot->overflow = malloc(len + 1))) {
+    write_log(LOG_ERR, "Monitor: Out of memory, can't hold on to report %lu...\n", seq);
+    unacked_count--;
+    return;
+  }
+  memcpy(copy, frame, len);
+  copy[len] = '\0';
+}
+
+// Function forgets every retained report the server has acknowledged.
+void ack_reports(unsigned long acked) {
+  while (unacked_count && unacked[unacked_start].seq <= acked) forget_report();
+}
+
+// Function forgets the oldest retained report.
+void forget_report() {
+  sent_report_t *slot = &unacked[unacked_start];
+  free(slot->overflow);
+  slot->overflow = NULL;
+  unacked_start = (unacked_start + 1) % NOTGIOS_UNACKED_MAX;
+  unacked_count--;
+}
+
+// Function resends every report the server hasn't acknowledged, oldest first. Reports stay
+// retained, as they still haven't been acknowledged.
+int resend_unacked() {
+  if (unacked_count) write_log(LOG_INFO, "Monitor: Resending %d unacknowledged reports...\n", unacked_count);
+  for (int i = 0; i < unacked_count; i++) {
+    sent_report_t *slot = &unacked[(unacked_start + i) % NOTGIOS_UNACKED_MAX];
+    if (send_message(slot->overflow ? slot->overflow : slot->frame) < 0) return NOTGIOS_SOCKET_CLOSED;
+  }
+  return NOTGIOS_SUCCESS;
+}
+
+// Function is where workers hand over their reports. Reports that collected something go
+// past the task's sampler first, on the task's own thread, which may decide to hold them back.
+void enqueue_report(task_report_t *report) {
+  task_t *task = find_task(report->id);
+  if (task && !report->message[0] && !sample_report(&task->sampler, &task->args, report)) return;
+  queue_report(task, report);
+}
+
+// Function is where samplers hand over alarms. Alarms are few, and worth more than any
+// report, so they get a queue of their own that the main thread always empties first.
+void enqueue_alarm(alarm_report_t *alarm) {
+  alarm_report_t evicted;
+  write_log(LOG_INFO, "Task %s: Alarm %s at %.2f...\n", alarm->id, alarm->breached ? "breached" : "cleared", alarm->value);
+  if (lpush_evict(&alarms, alarm, &evicted) == LIST_EVICTED) {
+    write_log(LOG_ERR, "Task %s: Alarm queue is full, dropping an alarm...\n", evicted.id);
+  }
+  eventfd_write(report_event, 1);
+}
+
+// Function queues a report to be sent. While we're connected, reports go into the in memory
+// queue, otherwise they're spooled to disk. The in memory queue is bounded, so a slow or
+// stuck server can't make us eat the host we're supposed to be monitoring. Anything thrown
+// away is counted against its task. task can be NULL, in which case the report is never
+// coalesced.
+void queue_report(task_t *task, task_report_t *report) {
+  if (!__atomic_load_n(&connected, __ATOMIC_SEQ_CST) && spooling) {
+    if (spool_append(&spool, report) != SPOOL_SUCCESS) {
+      write_log(LOG_ERR, "Task %s: Spool is full, dropping report...\n", report->id);
+      count_drop(report->id);
+    }
+    return;
+  }
+
+  task_report_t evicted;
+  int retval = lpush_from(&reports, report, &evicted, task ? &task->queued : NULL);
+  trace_event("queue push", TRACE_INSTANT, reports.count);
+  if (retval == LIST_FULL) {
+    count_drop(report->id);
+  } else if (retval == LIST_EVICTED) {
+    count_drop(evicted.id);
+  }
+
+  // If the connection went away between our check and our push, the main thread may have
+  // already spooled the queue, and won't look at it again until we're back. Spool it
+  // ourselves rather than leave this report behind everything spooled after it.
+  if (!__atomic_load_n(&connected, __ATOMIC_SEQ_CST) && spooling) spool_reports();
+
+  // Let the event loop know there's something to send.
+  eventfd_write(report_event, 1);
+}
+
+// Function records that a report for the given task was thrown away. Counter is only
+// ever touched atomically, as workers bump it while the main thread reads it.
+void count_drop(char *id) {
+  task_t *task = find_task(id);
+  write_log(LOG_DEBUG, "Task %s: Report queue is full, dropped a report...\n", id);
+  __atomic_add_fetch(&task_stats.dropped, 1, __ATOMIC_RELAXED);
+  if (task) __atomic_add_fetch(&task->dropped, 1, __ATOMIC_RELAXED);
+}
+
+// Function tacks a DROPPED line onto a formatted report if any reports for its task
+// have been thrown away since the last one we sent, so the server can explain the gap.
+void append_drops(task_report_t *report, char *buffer) {
+  task_t *task = find_task(report->id);
+  if (!task) return;
+
+  long num = __atomic_exchange_n(&task->dropped, 0, __ATOMIC_RELAXED);
+  if (num) sprintf(buffer + strlen(buffer) - 1, "DROPPED %ld\n\n", num);
+}
+
+// Function tacks an INTERVAL line onto a formatted report from an adaptive task, saying how
+// many seconds apart it's currently collecting.
+void append_interval(task_report_t *report, char *buffer) {
+  if (report->interval_ms) sprintf(buffer + strlen(buffer) - 1, "INTERVAL %.3f\n\n", report->interval_ms / 1000.0);
+}
+
+// Function tacks a WINDOW line onto a formatted report from a windowed task, summarizing
+// every sample it collected over the window, in the same units as the report itself.
+void append_window(task_report_t *report, char *buffer) {
+  summary_t *summary = &report->summary;
+  int precision = report->metric == MEMORY ? 0 : 2;
+
+  if (!summary->count) return;
+  sprintf(buffer + strlen(buffer) - 1, "WINDOW %.3f COUNT %ld MIN %.*f MAX %.*f MEAN %.*f P50 %.*f P95 %.*f P99 %.*f\n\n",
+      summary->window_ms / 1000.0, summary->count, precision, summary->min, precision, summary->max, precision,
+      summary->mean, precision, summary->p50, precision, summary->p95, precision, summary->p99);
+}
+
+// Function looks up the task a report or command refers to. Safe from any thread.
+task_t *find_task(char *id) {
+  uint64_t key;
+  if (parse_task_key(id, &key) != NOTGIOS_SUCCESS) return NULL;
+  return slotmap_get(&tasks, key);
+}
+
+// Function is used by the report queue to decide what it may coalesce. Errors and other
+// messages are only ever sent once, so only plain samples can be overwritten by newer ones.
+int plain_report(void *voidreport) {
+  task_report_t *report = voidreport;
+  return !report->message[0];
+}
+
+// Function writes the protocol message for a report into buffer.
+int format_report(task_report_t *report, char *buffer) {
+  int retval = NOTGIOS_SUCCESS;
+  char *start = "NGS JOB REPORT";
+
+  if (strlen(report->message) == 0) {
+    // Task is good.
+    switch (report->type) {
+      case PROCESS:
+        retval = handle_process_total_report(report, start, buffer);
+        break;
+      case DIRECTORY:
+        retval = handle_directory_report(report, start, buffer);
+        break;
+      case DISK:
+        retval = handle_disk_report(report, start, buffer);
+        break;
+      case SWAP:
+        retval = handle_swap_report(report, start, buffer);
+        break;
+      case LOAD:
+        retval = handle_load_report(report, start, buffer);
+        break;
+      case TOTAL:
+        retval = handle_process_total_report(report, start, buffer);
+        break;
+      case SELF:
+        retval = handle_self_report(report, start, buffer);
+        break;
+      default:
+        write_log(LOG_DEBUG, "Monitor: Found an invalid report while sending reports...\n");
+        retval = NOTGIOS_GENERIC_ERROR;
     }
+  } else {
+    // Task encountered an error.
+    sprintf(buffer, "%s\nID %s\nTIMESTAMP " NOTGIOS_TIMESTAMP_FMT "\n%s\n\n", start, report->id,
+        NOTGIOS_TIMESTAMP_ARGS(report->time_taken), report->message);
+  }
+
+  if (retval == NOTGIOS_SUCCESS) {
+    append_drops(report, buffer);
+    append_interval(report, buffer);
+    append_window(report, buffer);
   }
+  return retval;
+}
+
+// Function writes the protocol message for an alarm into buffer.
+void format_alarm(alarm_report_t *alarm, char *buffer) {
+  int precision = alarm->metric == MEMORY ? 0 : 2;
+
+  sprintf(buffer, "NGS JOB ALARM\nID %s\nTIMESTAMP " NOTGIOS_TIMESTAMP_FMT "\nSTATE %s\nVALUE %.*f\nTHRESHOLD %.*f\nPRIORITY %d\n\n",
+      alarm->id, NOTGIOS_TIMESTAMP_ARGS(alarm->time_taken), alarm->breached ? "BREACHED" : "CLEARED", precision, alarm->value,
+      precision, alarm->threshold, alarm->priority);
 }
 
 int handle_process_total_report(task_report_t *report, char *start, char *buffer) {
@@ -691,7 +1559,7 @@ int handle_process_total_report(task_report_t *report, char *start, char *buffer
   // Write our metric specific message.
   switch (report->metric) {
     case MEMORY:
-      sprintf(specific_msg, "BYTES %d", (int) report->value);
+      sprintf(specific_msg, "BYTES %ld", (long) report->value);
       break;
     case CPU:
       sprintf(specific_msg, "CPU PERCENT %.2f", report->percentage);
@@ -705,8 +1573,8 @@ int handle_process_total_report(task_report_t *report, char *start, char *buffer
   }
 
   // Write the full message.
-  long timestamp = report->time_taken;
-  sprintf(buffer, "%s\nID %s\nTIMESTAMP %ld\n%s\n\n", start, report->id, timestamp, specific_msg);
+  sprintf(buffer, "%s\nID %s\nTIMESTAMP " NOTGIOS_TIMESTAMP_FMT "\n%s\n\n", start, report->id,
+      NOTGIOS_TIMESTAMP_ARGS(report->time_taken), specific_msg);
   return NOTGIOS_SUCCESS;
 }
 
@@ -715,8 +1583,14 @@ int handle_directory_report(task_report_t *report, char *start, char *buffer) {
     write_log(LOG_DEBUG, "Monitor: Found an invalid directory report while sending reports...\n");
     return NOTGIOS_GENERIC_ERROR;
   }
-  long timestamp = report->time_taken;
-  sprintf(buffer, "%s\nID %s\nTIMESTAMP %ld\nBYTES %ld\n\n", start, report->id, timestamp, (long) report->value);
+  sprintf(buffer, "%s\nID %s\nTIMESTAMP " NOTGIOS_TIMESTAMP_FMT "\nBYTES %ld\n\n", start, report->id,
+      NOTGIOS_TIMESTAMP_ARGS(report->time_taken), (long) report->value);
+  return NOTGIOS_SUCCESS;
+}
+
+int handle_self_report(task_report_t *report, char *start, char *buffer) {
+  sprintf(buffer, "%s\nID %s\nTIMESTAMP " NOTGIOS_TIMESTAMP_FMT "\nCPU PERCENT %.2f\nCPU SECONDS %.2f\nBYTES %ld\nTHREADS %ld\nFDS %ld\nSWITCHES %ld\n\n",
+      start, report->id, NOTGIOS_TIMESTAMP_ARGS(report->time_taken), report->percentage, report->value, report->rss, report->threads, report->fds, report->switches);
   return NOTGIOS_SUCCESS;
 }
 
@@ -737,7 +1611,11 @@ int handle_load_report(task_report_t *report, char *start, char *buffer) {
 // The first type happens during initial startup, and the other if the server goes down for
 // any reason. The first type assumes the server will send over all tasks for this host, and
 // the second does not.
-int handshake(char *server_hostname, int port, int initial, short monitor_port) {
+// Servers that understand sessions keep the connection we open here, and resume where we
+// left off if we bring back a session they know. In that case the connected socket is handed
+// back through direct. Otherwise direct is left alone, and the server dials back to
+// monitor_port.
+int handshake(char *server_hostname, int port, int initial, short monitor_port, int *direct) {
   int sockfd, sleep_period = 1;
   struct sockaddr_in serv_addr;
   struct hostent *server;
@@ -755,21 +1633,44 @@ int handshake(char *server_hostname, int port, int initial, short monitor_port)
   write_log(LOG_DEBUG, "Monitor: Attempting to connect to server...\n");
   while (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
     write_log(LOG_ERR, "Monitor: Connect failed, sleeping for %d seconds...\n", sleep_period);
-    sleep(sleep_period);
+    if (wait_readable(-1, sleep_period) == NOTGIOS_IN_SHUTDOWN) {
+      close(sockfd);
+      return NOTGIOS_IN_SHUTDOWN;
+    }
     if (sleep_period < 32) sleep_period *= 2;
     if (sleep_period == 32 && initial) return NOTGIOS_SERVER_UNREACHABLE;
   }
 
   // Send hello message to server.
   memset(buffer, 0, sizeof(char) * NOTGIOS_STATIC_BUFSIZE);
-  if (initial) sprintf(buffer, "NGS HELLO\nCMD PORT %hd\n\n", monitor_port);
-  else sprintf(buffer, "NGS HELLO AGAIN\nCMD PORT %hd\n\n", monitor_port);
+  if (initial) sprintf(buffer, "NGS HELLO\nCMD PORT %hd\nSESSION NEW\n\n", monitor_port);
+  else sprintf(buffer, "NGS HELLO AGAIN\nCMD PORT %hd\nSESSION %s\n\n", monitor_port, session[0] ? session : "NEW");
   handle_write(sockfd, buffer);
 
-  // Get server's response.
-  handle_read(sockfd, buffer, NOTGIOS_STATIC_BUFSIZE);
-  if (strstr(buffer, "NGS ACK") == buffer) {
+  // Get server's response. If the server keeps the connection, it may send commands right
+  // behind its reply, so read through the same framer the event loop uses.
+  framer_clear(&inbound);
+  handle_read(sockfd, &inbound, buffer, NOTGIOS_STATIC_BUFSIZE);
+  if (exiting) {
     close(sockfd);
+    return NOTGIOS_IN_SHUTDOWN;
+  } else if (strstr(buffer, "NGS ACK") == buffer) {
+    char *line = strstr(buffer, "\nSESSION ");
+    unsigned long acked = 0;
+    char token[NOTGIOS_MAX_SESSION_LEN];
+    if (!line || sscanf(line, "\nSESSION %63s", token) != 1) {
+      close(sockfd);
+      return NOTGIOS_SUCCESS;
+    }
+
+    // Anything the server already has doesn't need to be sent again. If it didn't know our
+    // session, this comes back as zero and everything we're holding on to goes out again.
+    if ((line = strstr(buffer, "\nACKED "))) sscanf(line, "\nACKED %lu", &acked);
+    if (strcmp(token, session)) write_log(LOG_INFO, "Monitor: Starting new session %s...\n", token);
+    else write_log(LOG_INFO, "Monitor: Resuming session %s after report %lu...\n", token, acked);
+    strcpy(session, token);
+    ack_reports(acked);
+    *direct = sockfd;
     return NOTGIOS_SUCCESS;
   } else if (strstr(buffer, "NGS NACK") == buffer) {
     close(sockfd);
@@ -782,43 +1683,26 @@ int handshake(char *server_hostname, int port, int initial, short monitor_port)
 
 
 // Should be an extremely fault tolerant wrapper around read.
-// Keeps reading until encountering a double newline.
+// Keeps reading until frm holds a complete frame, and copies it into buffer.
 // Zeros buffer before reading to it.
-// Can block for a maximum of NOTGIOS_READ_TIMEOUT. If no data is available at the
-// end of the timeout, assumes there is a problem with the socket, and returns
+// Can block for a maximum of NOTGIOS_READ_TIMEOUT between reads. If no data is available
+// at the end of the timeout, assumes there is a problem with the socket, and returns
 // NOTGIOS_SOCKET_CLOSED.
-int handle_read(int fd, char *buffer, int len) {
-  int actual = 0, e_count = 0;
+int handle_read(int fd, framer_t *frm, char *buffer, int len) {
+  int retval;
   memset(buffer, 0, sizeof(char) * len);
-  while (actual < 2 || buffer[strlen(buffer) - 1] != '\n' || buffer[strlen(buffer) - 2] != '\n') {
-    fd_set to_read;
-    FD_ZERO(&to_read);
-    FD_SET(fd, &to_read);
-    FD_SET(termpipe_out, &to_read);
-    struct timeval time;
-    time.tv_sec = NOTGIOS_READ_TIMEOUT;
-    time.tv_usec = 0;
-
-    select(SIMPLE_MAX(fd, termpipe_out) + 1, &to_read, NULL, NULL, &time);
-    if (FD_ISSET(fd, &to_read)) {
-      // We've received data from the server, time to read it.
-      int retval = read(fd, buffer, len);
-      if (retval > 0) {
-        e_count = 0;
-        actual += retval;
-      } else if (retval == 0 || e_count++ > 5) {
-        return NOTGIOS_SOCKET_CLOSED;
-      }
-    } else if (FD_ISSET(termpipe_out, &to_read)) {
-      // Data was written from the SIGTERM handler. We're in shutdown. Erase anything that was
-      // read off the socket (make sure we don't pass along partial data) and return immediately.
+  while ((retval = framer_next(frm, buffer, len)) == FRAMER_EMPTY) {
+    int ready = wait_readable(fd, NOTGIOS_READ_TIMEOUT);
+    if (ready == NOTGIOS_IN_SHUTDOWN) {
+      // We received a SIGTERM while waiting. Make sure we don't pass along partial data and
+      // return immediately.
       memset(buffer, 0, sizeof(char) * len);
       return 0;
-    } else {
+    } else if (!ready || framer_fill(frm, fd) < 0) {
       return NOTGIOS_SOCKET_CLOSED;
     }
   }
-  return actual;
+  return retval == FRAMER_TOOBIG ? NOTGIOS_GENERIC_ERROR : retval;
 }
 
 // Should be an extremely fault tolerant wrapper around write.
@@ -828,10 +1712,12 @@ int handle_read(int fd, char *buffer, int len) {
 // full, and that either we're writing data too quickly, or the remote end has experienced an
 // unexpected shutdown. In an attempt to disambiguate this, function blocks for a maximum of
 // NOTGIOS_WRITE_TIMEOUT, before either writing the data or returning NOTGIOS_SOCKET_CLOSED.
+// Only used for the handshake now, everything on the established connection goes through
+// the outbound buffer.
 int handle_write(int fd, char *buffer) {
   int actual = 0, expected = strlen(buffer);
   while (actual != expected) {
-    int retval = write(fd, buffer, expected - actual);
+    int retval = write(fd, buffer + actual, expected - actual);
     if (retval >= 0) {
       actual += retval;
     } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -843,13 +1729,121 @@ int handle_write(int fd, char *buffer) {
       time.tv_usec = 0;
       select(fd + 1, NULL, &to_write, NULL, &time);
       if (!FD_ISSET(fd, &to_write)) return NOTGIOS_SOCKET_CLOSED;
-    } else if (errno == EPIPE) {
+    } else if (errno != EINTR) {
+      // EPIPE, ECONNRESET, and friends. Spinning here would wedge the handshake.
       return NOTGIOS_SOCKET_CLOSED;
     }
   }
   return actual;
 }
 
+// Function is the single write path for the server connection. Replies and reports both
+// go out through here. Nothing ever blocks, messages are queued in the outbound buffer and
+// written as the socket takes them. If a write fails, the socket is shut down so that the
+// event loop notices right away and starts reconnecting.
+// Returns NOTGIOS_NOT_QUEUED if the message never made it into the outbound buffer, and
+// NOTGIOS_SOCKET_CLOSED if it did, but the socket failed while writing it, in which case
+// some or all of it may already be on the wire.
+int send_message(char *buffer) {
+  if (!connected) return NOTGIOS_NOT_QUEUED;
+
+  // If there's already a backlog we're waiting on EPOLLOUT, so don't bother trying the
+  // socket until it says it has room.
+  int backlog = outbound.len;
+  if (outbuf_append(&outbound, buffer, strlen(buffer)) != OUTBUF_SUCCESS) {
+    write_log(LOG_ERR, "Monitor: Outbound buffer can't take any more, reconnecting...\n");
+    shutdown(connection, SHUT_RDWR);
+    return NOTGIOS_NOT_QUEUED;
+  }
+  return backlog ? NOTGIOS_SUCCESS : flush_outbound();
+}
+
+// Function writes as much of the outbound buffer as the socket will take, and makes sure
+// we hear about it when there's room for the rest.
+int flush_outbound() {
+  long written = outbound.written;
+  int pending = outbuf_flush(&outbound, connection);
+  trace_event("socket write", TRACE_INSTANT, outbound.written - written);
+  if (pending < 0) {
+    shutdown(connection, SHUT_RDWR);
+    return NOTGIOS_SOCKET_CLOSED;
+  }
+  watch_writable(pending > 0);
+  return NOTGIOS_SUCCESS;
+}
+
+// Function turns EPOLLOUT notifications for the connection on or off.
+void watch_writable(int on) {
+  if (on == writing) return;
+
+  struct epoll_event event;
+  event.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  event.data.fd = connection;
+  if (!epoll_ctl(events_fd, EPOLL_CTL_MOD, connection, &event)) writing = on;
+}
+
+// Function blocks for up to timeout seconds trying to get everything in the outbound buffer
+// onto the wire. Only meant for shutdown, when there's nothing left to do but wait.
+void drain_outbound(int timeout) {
+  struct timespec now, deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout;
+
+  while (connected && outbuf_flush(&outbound, connection) > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long remaining = (deadline.tv_sec - now.tv_sec) * 1000000L + (deadline.tv_nsec - now.tv_nsec) / 1000;
+    if (remaining <= 0) return;
+
+    fd_set to_write;
+    FD_ZERO(&to_write);
+    FD_SET(connection, &to_write);
+    struct timeval time;
+    time.tv_sec = remaining / 1000000L;
+    time.tv_usec = remaining % 1000000L;
+    select(connection + 1, NULL, &to_write, NULL, &time);
+  }
+}
+
+// Function blocks until fd is readable, or timeout seconds pass, handling any signals that
+// come in along the way. Passing -1 for fd just sleeps. Returns 1 if fd is readable, 0 on
+// timeout, and NOTGIOS_IN_SHUTDOWN if we were told to shut down.
+int wait_readable(int fd, int timeout) {
+  struct timespec now, deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout;
+
+  while (!exiting) {
+    fd_set to_read;
+    FD_ZERO(&to_read);
+    FD_SET(signal_fd, &to_read);
+    if (fd >= 0) FD_SET(fd, &to_read);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long remaining = (deadline.tv_sec - now.tv_sec) * 1000000L + (deadline.tv_nsec - now.tv_nsec) / 1000;
+    if (remaining <= 0) return 0;
+    struct timeval time;
+    time.tv_sec = remaining / 1000000L;
+    time.tv_usec = remaining % 1000000L;
+
+    if (select((fd > signal_fd ? fd : signal_fd) + 1, &to_read, NULL, NULL, &time) < 0) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+    if (FD_ISSET(signal_fd, &to_read)) handle_signals();
+    if (fd >= 0 && FD_ISSET(fd, &to_read)) return 1;
+  }
+  return NOTGIOS_IN_SHUTDOWN;
+}
+
+// Function (re)starts the countdown until we decide the server has gone away. Server sends
+// a keepalive every 10 seconds, so we should always hear from it well within the timeout.
+void arm_read_timer() {
+  struct itimerspec timeout;
+  memset(&timeout, 0, sizeof(timeout));
+  timeout.it_value.tv_sec = NOTGIOS_READ_TIMEOUT;
+  timerfd_settime(read_timer, 0, &timeout, NULL);
+}
+
 // Function opens a listening socket on NOTGIOS_MONITOR_PORT and marks it as
 // nonblocking.
 int create_server(short port) {
@@ -867,28 +1861,43 @@ int create_server(short port) {
   return server_fd;
 }
 
-thread_control_t *create_thread_control() {
-  thread_control_t *control = malloc(sizeof(thread_control_t));
-
-  if (control) {
-    control->paused = 0;
-    control->killed = 0;
-    control->dropped = 0;
-    pthread_cond_init(&control->signal, NULL);
-    pthread_mutex_init(&control->mutex, NULL);
-  }
+// Function turns a task id from the server into the key for the task table. Ids come out of
+// a counter on the server, so anything that isn't a plain number is malformed.
+int parse_task_key(char *id, uint64_t *key) {
+  char *end;
+  if (!isdigit((unsigned char) id[0])) return NOTGIOS_GENERIC_ERROR;
+  errno = 0;
+  *key = strtoull(id, &end, 10);
+  if (*end || errno) return NOTGIOS_GENERIC_ERROR;
+  return NOTGIOS_SUCCESS;
+}
 
-  return control;
+void init_thread_control(thread_control_t *control) {
+  control->paused = 0;
+  control->killed = 0;
+  control->dropped = 0;
+
+  // Deadlines are on the monotonic clock, so the wall clock can be stepped without
+  // disturbing anyone's schedule.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&control->signal, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&control->mutex, NULL);
 }
 
-void destroy_thread_control(void *voidarg) {
-  thread_control_t *control = voidarg;
-  if (control) {
-    pthread_cond_broadcast(&control->signal);
-    pthread_cond_destroy(&control->signal);
-    pthread_mutex_destroy(&control->mutex);
-    free(control);
-  }
+// Function is the destructor for the task table. Entries are stored inline, so this only
+// has to tear down what's inside.
+void destroy_task(void *voidarg) {
+  task_t *task = voidarg;
+  list_disown(&reports, &task->queued);
+  release_sampler(&task->sampler);
+  free(task->timing);
+  pthread_cond_broadcast(&task->control.signal);
+  pthread_cond_destroy(&task->control.signal);
+  pthread_mutex_destroy(&task->control.mutex);
+  release_self_probe(&task->self);
 }
 
 int parse_commands(char **output, char *input) {
@@ -896,91 +1905,102 @@ int parse_commands(char **output, char *input) {
   memset(output, 0, sizeof(char *) * (NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS));
   char *current = strtok(input, "\n");
   do {
-    if (elem == 16) return NOTGIOS_TOO_MANY_ARGS;
+    if (elem == NOTGIOS_REQUIRED_COMMANDS + NOTGIOS_MAX_OPTIONS) return NOTGIOS_TOO_MANY_ARGS;
     output[elem++] = current;
   } while ((current = strtok(NULL, "\n")));
   return NOTGIOS_SUCCESS;
 }
 
 void remove_dead() {
-  char **tasks = hash_keys(&threads);
-  for (char **current = tasks, *task_id = *current; current - tasks < threads.count; current++, task_id = *current) {
-    pthread_t *thread = hash_get(&threads, task_id);
-    thread_control_t *control = hash_get(&controls, task_id);
+  int cursor = 0;
+  task_t *task;
+  while ((task = slotmap_next(&tasks, &cursor))) {
+    thread_control_t *control = &task->control;
 
     // Not necessary to acquire lock. We only remove the task if dropped is set, in which case the thread is no longer
     // running, and if we happen to read dropped while it's being set, it'll be cleaned up next round.
     // Futhermore, we're the only thread that removes tasks.
     if (control->dropped) {
       write_log(LOG_INFO, "Monitor: Removing a dead task...\n");
-      pthread_join(*thread, NULL);
-      hash_drop(&threads, task_id);
-      hash_drop(&controls, task_id);
+      pthread_join(task->thread, NULL);
 
       // Currently tasks can only really fail if there's like a serious problem with the system setup (unsupported distro)
       // or if there's an unrecoverable error that meant the task couldn't be recovered. Should never be any children
-      // running, but whatever.
-      hash_drop(&children, task_id);
+      // running, but whatever. The child goes away with the rest of the task.
+      slotmap_drop(&tasks, task->args.key);
     }
   }
-  free(tasks);
   write_log(LOG_DEBUG, "Monitor: Finished cleaning up dead tasks...\n");
 }
 
+// Function updates the task counts. Workers call this as they start and stop, so it's all
+// atomic.
 void increment_stats(task_type_t type, char *id) {
-  pthread_rwlock_wrlock(&stats_lock);
-  task_stats.num_tasks++;
-  switch (type) {
-    case PROCESS:
-      task_stats.num_process_tasks++;
-      break;
-    case DIRECTORY:
-      task_stats.num_dir_tasks++;
-      break;
-    case DISK:
-      task_stats.num_disk_tasks++;
-      break;
-    case SWAP:
-      task_stats.num_swap_tasks++;
-      break;
-    case LOAD:
-      task_stats.num_load_tasks++;
-      break;
-    case TOTAL:
-      task_stats.num_total_tasks++;
-      break;
-    default:
-      write_log(LOG_DEBUG, "Task %s: Invalid task encountered during stat update...\n", id);
-  }
-  pthread_rwlock_unlock(&stats_lock);
+  __atomic_add_fetch(&task_stats.num_tasks, 1, __ATOMIC_RELAXED);
+  if (type > NO_TYPE && type < NOTGIOS_NUM_TYPES) __atomic_add_fetch(&task_stats.num_by_type[type], 1, __ATOMIC_RELAXED);
+  else write_log(LOG_DEBUG, "Task %s: Invalid task encountered during stat update...\n", id);
 }
 
 void decrement_stats(task_type_t type, char *id) {
-  pthread_rwlock_wrlock(&stats_lock);
-  task_stats.num_tasks--;
-  switch (type) {
-    case PROCESS:
-      task_stats.num_process_tasks--;
-      break;
-    case DIRECTORY:
-      task_stats.num_dir_tasks--;
-      break;
-    case DISK:
-      task_stats.num_disk_tasks--;
-      break;
-    case SWAP:
-      task_stats.num_swap_tasks--;
-      break;
-    case LOAD:
-      task_stats.num_load_tasks--;
-      break;
-    case TOTAL:
-      task_stats.num_total_tasks--;
-      break;
-    default:
-      write_log(LOG_DEBUG, "Task %s: Invalid task encountered during stat update...\n", id);
+  __atomic_sub_fetch(&task_stats.num_tasks, 1, __ATOMIC_RELAXED);
+  if (type > NO_TYPE && type < NOTGIOS_NUM_TYPES) __atomic_sub_fetch(&task_stats.num_by_type[type], 1, __ATOMIC_RELAXED);
+  else write_log(LOG_DEBUG, "Task %s: Invalid task encountered during stat update...\n", id);
+}
+
+// Function records the time between start and end, in microseconds, into a task's histogram
+// and its type's. An end before the start counts as zero.
+void record_timing(histogram_t *task_hist, histogram_t *type_hist, struct timespec *start, struct timespec *end) {
+  long elapsed = (end->tv_sec - start->tv_sec) * 1000000L + (end->tv_nsec - start->tv_nsec) / 1000;
+  if (elapsed < 0) elapsed = 0;
+  histogram_record(task_hist, elapsed);
+  histogram_record(type_hist, elapsed);
+}
+
+// Function works out when a task should first run. Every task with a given frequency runs
+// on the same grid of periods on the monotonic clock, each at its own offset into the
+// period, picked by hashing its key, so tasks added together don't all fire together, and
+// a task lands in the same spot every time it's added.
+void schedule_first(struct timespec *deadline, int freq_ms, uint64_t key) {
+  uint64_t period = freq_ms * NOTGIOS_NSEC_PER_MSEC, now;
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = ts.tv_sec * NOTGIOS_NSEC_PER_SEC + ts.tv_nsec;
+  // Mixing the key and scaling it by the period, rather than taking it modulo the period,
+  // covers all of a long period, not just its first few seconds.
+  uint64_t offset = (uint64_t) (((unsigned __int128) (key * NOTGIOS_PHASE_HASH) * period) >> 64);
+  uint64_t first = now - now % period + offset;
+  if (first < now) first += period;
+  deadline->tv_sec = first / NOTGIOS_NSEC_PER_SEC;
+  deadline->tv_nsec = first % NOTGIOS_NSEC_PER_SEC;
+}
+
+// Function moves deadline to the first slot in the task's schedule at or after now. A slot
+// that falls exactly on now is still due, not missed. Returns how many slots were skipped
+// along the way.
+long schedule_next(struct timespec *deadline, int freq_ms, struct timespec *now) {
+  uint64_t period = freq_ms * NOTGIOS_NSEC_PER_MSEC;
+  uint64_t next = deadline->tv_sec * NOTGIOS_NSEC_PER_SEC + deadline->tv_nsec + period;
+  uint64_t current = now->tv_sec * NOTGIOS_NSEC_PER_SEC + now->tv_nsec;
+
+  long missed = 0;
+  if (next < current) {
+    missed = (current - next + period - 1) / period;
+    next += missed * period;
   }
-  pthread_rwlock_unlock(&stats_lock);
+  deadline->tv_sec = next / NOTGIOS_NSEC_PER_SEC;
+  deadline->tv_nsec = next % NOTGIOS_NSEC_PER_SEC;
+  return missed;
+}
+
+// Function is where the logger sends every message once it's formatted.
+void log_sink(int priority, char *message) {
+#ifdef DEBUG
+  (void) priority;
+  fputs(message, stderr);
+#else
+  syslog(priority, "%s", message);
+#endif
 }
 
 void user_error() {
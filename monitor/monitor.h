@@ -3,7 +3,17 @@
 
 /*----- System Includes -----*/
 
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
 #include <pthread.h>
+#include <sys/types.h>
+
+/*----- Local Includes -----*/
+
+#include "../include/histogram.h"
+#include "../include/logger.h"
+#include "../include/list.h"
 
 /*----- Constant Declarations -----*/
 
@@ -13,16 +23,44 @@
 #define NOTGIOS_READ_TIMEOUT 20
 #define NOTGIOS_WRITE_TIMEOUT 4
 #define NOTGIOS_STATIC_BUFSIZE 512
+#define NOTGIOS_FRAME_BUFSIZE (1 << 18)
 #define NOTGIOS_SMALL_BUFSIZE 32
 #define NOTGIOS_ERROR_BUFSIZE 64
+#define NOTGIOS_BATCH_LINE_LEN 64
 #define NOTGIOS_REQUIRED_COMMANDS 5
-#define NOTGIOS_MAX_OPTIONS 4
+#define NOTGIOS_MAX_OPTIONS 8
 #define NOTGIOS_MAX_OPTION_LEN 128
 #define NOTGIOS_MAX_TYPE_LEN 16
 #define NOTGIOS_MAX_METRIC_LEN 8
 #define NOTGIOS_MAX_NUM_LEN 12
 #define NOTGIOS_MAX_ARGS 32
-#define NOTGIOS_MAX_PROC_LEN 32
+#define NOTGIOS_CPU_INTERVAL_US 1000000
+#define NOTGIOS_NSEC_PER_SEC 1000000000ULL
+#define NOTGIOS_NSEC_PER_MSEC 1000000ULL
+#define NOTGIOS_MIN_FREQ_MS 10
+#define NOTGIOS_MAX_FREQ_MS (86400 * 1000)
+#define NOTGIOS_ADAPTIVE_CALM 3
+#define NOTGIOS_HEARTBEAT_MS 60000
+#define NOTGIOS_WINDOW_SCALE 100
+#define NOTGIOS_PHASE_HASH 0x9E3779B97F4A7C15ULL
+#define NOTGIOS_SPOOL_MAX_MB 64
+#define NOTGIOS_SPOOL_BATCH 32
+#define NOTGIOS_QUEUE_MAX 4096
+#define NOTGIOS_ALARM_QUEUE_MAX 256
+#define NOTGIOS_MAX_EVENTS 16
+#define NOTGIOS_MAX_SESSION_LEN 64
+#define NOTGIOS_UNACKED_MAX 4096
+#define NOTGIOS_OUTBUF_HIGH (1 << 20)
+#define NOTGIOS_OUTBUF_LOW (1 << 18)
+#ifdef DEBUG
+#define NOTGIOS_LOG_LEVEL LOG_DEBUG
+#else
+#define NOTGIOS_LOG_LEVEL LOG_INFO
+#endif
+
+// String Constants
+#define NOTGIOS_SPOOL_DIR "/var/spool/notgios"
+#define NOTGIOS_PROC_ROOT "/proc"
 
 // Return values
 #define NOTGIOS_SUCCESS 0x0
@@ -39,15 +77,18 @@
 #define NOTGIOS_IN_SHUTDOWN -0x400
 #define NOTGIOS_BAD_ACCESS -0x800
 #define NOTGIOS_NO_FILES -0x1000
+#define NOTGIOS_NOT_QUEUED -0x2000
 
 /*----- Macro Declarations -----*/
 
-// Declare ourselves a logging function based on our environment.
-#ifdef DEBUG
-#define write_log(priority, ...) fprintf(stderr, __VA_ARGS__)
-#else
-#define write_log(priority, ...) syslog(priority, __VA_ARGS__)
-#endif
+// Messages are handed to the logger, which formats and writes them out on its own thread,
+// to stderr or syslog depending on our environment. Arguments aren't even evaluated unless
+// the priority is currently being logged.
+#define write_log(priority, ...)                                        \
+  do {                                                                  \
+    if ((priority) <= __atomic_load_n(&logger_level, __ATOMIC_RELAXED)) \
+      logger_write(priority, __VA_ARGS__);                              \
+  } while (0)
 
 
 /*----- Type Declaractions -----*/
@@ -59,9 +100,12 @@ typedef enum {
   DISK,
   SWAP,
   LOAD,
-  TOTAL
+  TOTAL,
+  SELF
 } task_type_t;
 
+#define NOTGIOS_NUM_TYPES (SELF + 1)
+
 typedef enum {
   NONE,
   MEMORY,
@@ -95,18 +139,116 @@ typedef struct thread_control {
   pthread_mutex_t mutex;
 } thread_control_t;
 
+// Struct represents a tolerance around a value, either as an absolute amount, or as a
+// percentage of the value.
+typedef struct band {
+  double width;
+  int percent;
+} band_t;
+
+// Struct holds the bounds an adaptive task's interval moves between, and how much its value
+// has to move between samples before it's considered volatile. Disabled if min_ms is zero.
+typedef struct adaptive {
+  int min_ms, max_ms;
+  band_t band;
+} adaptive_t;
+
+// Struct holds how far a task's value has to move from the last one it sent before it's
+// worth sending again, and the longest it goes without sending anyway. Disabled if
+// heartbeat_ms is zero.
+typedef struct deadband {
+  band_t band;
+  int heartbeat_ms;
+} deadband_t;
+
+// Struct holds the threshold a task's value raises an alarm past, and how far back past it
+// the value has to come before the alarm clears. Disabled if enabled is zero.
+typedef struct alarm {
+  double threshold;
+  band_t hysteresis;
+  int below, priority, enabled;
+} alarm_t;
+
 typedef struct thread_args {
-  int freq;
+  int freq_ms;
+  uint64_t key;
   char id[NOTGIOS_MAX_NUM_LEN];
   task_type_t type;
   metric_type_t metric;
   thread_control_t *control;
   task_option_t options[NOTGIOS_MAX_OPTIONS];
+  adaptive_t adaptive;
+  deadband_t deadband;
+  alarm_t alarm;
+  int window_ms;
 } thread_args_t;
 
+// Struct holds a windowed task's samples since its window opened. Samples go into the
+// histogram in bytes, or in hundredths of a percent, so percentiles are known to within the
+// histogram's 12.5%, while min, max and mean are exact. The histogram is only allocated for
+// tasks that have a window.
+typedef struct window {
+  long count;
+  double min, max, sum;
+  histogram_t *hist;
+  struct timespec closes;
+} window_t;
+
+// Struct holds what a task remembers about its own recent samples, so it can decide how
+// often to collect, and what to send. Only ever touched by the task's own thread.
+typedef struct sampler {
+  int interval_ms, calm, primed, sent_primed, alarmed;
+  double last, sent;
+  struct timespec sent_at;
+  window_t window;
+} sampler_t;
+
+// Struct holds what a SELF task keeps between samples, so it can reread its proc files
+// without reopening them, and work out CPU usage since the last time around. Only ever
+// touched by the task's own thread, and by whoever destroys the task.
+typedef struct self_probe {
+  int statm_fd, stat_fd;
+  DIR *fd_dir;
+  long cpu_usec;
+  struct timespec taken;
+} self_probe_t;
+
+// Struct holds a task's own timing histograms, in microseconds.
+typedef struct task_timing {
+  histogram_t collect, lateness;
+} task_timing_t;
+
+// Struct holds everything the monitor knows about a single task. Lives in the task table,
+// which never moves it, so the task's thread can keep a pointer to it for its whole life.
+// queued is the task's newest report in the report queue, and belongs to the queue. timing
+// stays NULL until someone first asks for stats, and is only ever swapped in atomically.
+typedef struct task {
+  pthread_t thread;
+  thread_args_t args;
+  thread_control_t control;
+  pid_t child;
+  long dropped, missed;
+  list_node_t *queued;
+  task_timing_t *timing;
+  self_probe_t self;
+  sampler_t sampler;
+} task_t;
+
+// Struct holds a report that's been sent but not yet acknowledged. Frames almost always fit
+// inline, the odd one that doesn't is kept in overflow instead.
+typedef struct sent_report {
+  unsigned long seq;
+  char *overflow;
+  char frame[NOTGIOS_STATIC_BUFSIZE];
+} sent_report_t;
+
+// Struct holds the monitor's numbers about itself. Everything in here is only ever touched
+// atomically, or only by the main thread. Histograms are in microseconds. Lateness is
+// measured against each task's fixed schedule, so it's also how far the task has drifted.
 typedef struct monitor_stats {
-  int num_tasks, num_process_tasks, num_dir_tasks, num_disk_tasks, num_swap_tasks;
-  int num_load_tasks, num_total_tasks;
+  int num_tasks, num_by_type[NOTGIOS_NUM_TYPES];
+  long bytes_sent, reports_sent, alarms_sent, reconnects, dropped, suppressed, missed[NOTGIOS_NUM_TYPES];
+  histogram_t collect[NOTGIOS_NUM_TYPES], lateness[NOTGIOS_NUM_TYPES];
 } monitor_stats_t;
 
 #endif
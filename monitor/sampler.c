@@ -0,0 +1,283 @@
+/*----- System Includes -----*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*----- Local Includes -----*/
+
+#include "sampler.h"
+
+// Options are parsed on the main thread as tasks are added. Everything else runs on a task's
+// own thread, right after it collects, and decides what happens to the sample, and when the
+// task collects next.
+
+/*----- Evil but Necessary Globals -----*/
+
+extern monitor_stats_t task_stats;
+
+/*----- Function Implementations -----*/
+
+// Function parses the value of an ADAPTIVE option, which looks like "<min> <max> <band>",
+// with the bounds in seconds like FREQ, and the band like parse_band takes it. Returns NULL
+// if everything checks out, or the cause to NACK with if not.
+char *parse_adaptive(char *value, adaptive_t *adaptive) {
+  double min, max;
+  char band[NOTGIOS_MAX_OPTION_LEN];
+
+  if (sscanf(value, "%lf %lf %127s", &min, &max, band) != 3) return "MALFORMED_OPTION";
+  if (!(min >= NOTGIOS_MIN_FREQ_MS / 1000.0 && max <= NOTGIOS_MAX_FREQ_MS / 1000.0 && min <= max)) return "BAD_FREQ";
+  if (parse_band(band, &adaptive->band) != NOTGIOS_SUCCESS) return "MALFORMED_OPTION";
+
+  adaptive->min_ms = (int) (min * 1000 + 0.5);
+  adaptive->max_ms = (int) (max * 1000 + 0.5);
+  return NULL;
+}
+
+// Function parses the value of a DEADBAND option, which looks like "<band> [heartbeat]", with
+// the band like parse_band takes it, and the heartbeat in seconds. Returns NULL if
+// everything checks out, or the cause to NACK with if not.
+char *parse_deadband(char *value, deadband_t *deadband) {
+  double heartbeat = NOTGIOS_HEARTBEAT_MS / 1000.0;
+  char band[NOTGIOS_MAX_OPTION_LEN];
+
+  int retval = sscanf(value, "%127s %lf", band, &heartbeat);
+  if (retval < 1 || parse_band(band, &deadband->band) != NOTGIOS_SUCCESS) return "MALFORMED_OPTION";
+  if (!(heartbeat >= NOTGIOS_MIN_FREQ_MS / 1000.0 && heartbeat <= NOTGIOS_MAX_FREQ_MS / 1000.0)) return "BAD_FREQ";
+
+  deadband->heartbeat_ms = (int) (heartbeat * 1000 + 0.5);
+  return NULL;
+}
+
+// Function parses the value of a WINDOW option, which is how many seconds a windowed task
+// summarizes its samples over before sending anything. Returns NULL if everything checks
+// out, or the cause to NACK with if not.
+char *parse_window(char *value, int *window_ms) {
+  double window;
+  char *end;
+
+  window = strtod(value, &end);
+  if (end == value || *end) return "MALFORMED_OPTION";
+  if (!(window >= NOTGIOS_MIN_FREQ_MS / 1000.0 && window <= NOTGIOS_MAX_FREQ_MS / 1000.0)) return "BAD_FREQ";
+
+  *window_ms = (int) (window * 1000 + 0.5);
+  return NULL;
+}
+
+// Function parses the value of an ALARM option, which looks like
+// "<threshold> [hysteresis] [priority]", with the threshold in the same units as the task's
+// reports, and prefixed with '<' if it's falling below it that should raise the alarm. The
+// hysteresis is a band like parse_band takes, and defaults to none. Returns NULL if
+// everything checks out, or the cause to NACK with if not.
+char *parse_alarm(char *value, alarm_t *alarm) {
+  char threshold[NOTGIOS_MAX_OPTION_LEN], hysteresis[NOTGIOS_MAX_OPTION_LEN] = "0";
+  char *start = threshold, *end;
+
+  alarm->priority = 0;
+  if (sscanf(value, "%127s %127s %d", threshold, hysteresis, &alarm->priority) < 1) return "MALFORMED_OPTION";
+  alarm->below = *start == '<';
+  if (*start == '<' || *start == '>') start++;
+  alarm->threshold = strtod(start, &end);
+  if (end == start || *end || parse_band(hysteresis, &alarm->hysteresis) != NOTGIOS_SUCCESS) return "MALFORMED_OPTION";
+
+  alarm->enabled = 1;
+  return NULL;
+}
+
+// Function parses a band, which is either an absolute amount, like "1048576", or a
+// percentage, like "5%".
+int parse_band(char *value, band_t *band) {
+  char *end;
+  band->width = strtod(value, &end);
+  band->percent = *end == '%';
+  if (end == value || (*end && strcmp(end, "%")) || !(band->width >= 0)) return NOTGIOS_GENERIC_ERROR;
+  return NOTGIOS_SUCCESS;
+}
+
+// Function gets a task's sampler ready to go. Returns NOTGIOS_GENERIC_ERROR if there's no
+// memory for a windowed task's histogram.
+int init_sampler(sampler_t *sampler, thread_args_t *args) {
+  adaptive_t *adaptive = &args->adaptive;
+
+  sampler->interval_ms = args->freq_ms;
+  if (adaptive->min_ms) {
+    if (sampler->interval_ms < adaptive->min_ms) sampler->interval_ms = adaptive->min_ms;
+    if (sampler->interval_ms > adaptive->max_ms) sampler->interval_ms = adaptive->max_ms;
+  }
+  sampler->calm = 0;
+  sampler->primed = 0;
+  sampler->sent_primed = 0;
+  sampler->alarmed = 0;
+  sampler->last = 0;
+  sampler->sent = 0;
+  sampler->window.count = 0;
+  sampler->window.closes.tv_sec = 0;
+  sampler->window.closes.tv_nsec = 0;
+  sampler->window.hist = NULL;
+  if (args->window_ms && !(sampler->window.hist = create_histogram())) return NOTGIOS_GENERIC_ERROR;
+  return NOTGIOS_SUCCESS;
+}
+
+void release_sampler(sampler_t *sampler) {
+  destroy_histogram(sampler->window.hist);
+  sampler->window.hist = NULL;
+}
+
+// Function looks over a freshly collected report before it's queued. Every sample is
+// checked against the task's alarm, if it has one, before anything else happens to it.
+// Adaptive tasks drop straight to their fastest interval as soon as their value jumps out
+// of its band, so an incident is seen in full, and double their interval, up to the
+// slowest, after every NOTGIOS_ADAPTIVE_CALM samples in a row that stay inside it. Their
+// reports say what interval they were collected at.
+// Windowed tasks then hold every sample back until their window closes, and send the last
+// one with a summary of the whole window attached.
+// Tasks with a deadband then only send reports that have moved out of the band around the
+// last one they sent, or once their heartbeat has gone by without sending anything, so a
+// quiet task can still be told apart from a dead one. Windowed tasks are judged on their
+// window's mean.
+// Returns whether the report should be sent.
+int sample_report(sampler_t *sampler, thread_args_t *args, task_report_t *report) {
+  adaptive_t *adaptive = &args->adaptive;
+  deadband_t *deadband = &args->deadband;
+  double value = report_signal(report);
+  struct timespec now;
+
+  if (args->alarm.enabled) check_alarm(sampler, &args->alarm, report, value);
+  if (adaptive->min_ms) {
+    report->interval_ms = sampler->interval_ms;
+    if (sampler->primed && !within_band(&adaptive->band, sampler->last, value)) {
+      sampler->interval_ms = adaptive->min_ms;
+      sampler->calm = 0;
+    } else if (++sampler->calm >= NOTGIOS_ADAPTIVE_CALM) {
+      sampler->interval_ms *= 2;
+      if (sampler->interval_ms > adaptive->max_ms) sampler->interval_ms = adaptive->max_ms;
+      sampler->calm = 0;
+    }
+  }
+  sampler->last = value;
+  sampler->primed = 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (args->window_ms) {
+    if (!window_sample(&sampler->window, args->window_ms, sampler->interval_ms, &now, report, value)) return 0;
+    value = report->summary.mean;
+  }
+  if (!deadband->heartbeat_ms) return 1;
+
+  long quiet_ms = (now.tv_sec - sampler->sent_at.tv_sec) * 1000 + (now.tv_nsec - sampler->sent_at.tv_nsec) / 1000000;
+  // Heartbeats go out on the sample closest to when they're due, rather than the first one
+  // after.
+  int heartbeat_due = quiet_ms + sampler->interval_ms / 2 >= deadband->heartbeat_ms;
+  if (sampler->sent_primed && !heartbeat_due && within_band(&deadband->band, sampler->sent, value)) {
+    __atomic_add_fetch(&task_stats.suppressed, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  sampler->sent = value;
+  sampler->sent_at = now;
+  sampler->sent_primed = 1;
+  return 1;
+}
+
+// Function checks a sample against its task's alarm. Alarms go off as soon as the value is
+// past the threshold, and only clear once it's come back past it by the hysteresis, so a
+// value hovering around the threshold raises one alarm rather than one every sample. Both
+// edges are handed straight to the main thread, which sends them ahead of any reports.
+void check_alarm(sampler_t *sampler, alarm_t *alarm, task_report_t *report, double value) {
+  double margin = band_width(&alarm->hysteresis, alarm->threshold);
+  alarm_report_t edge;
+
+  if (sampler->alarmed) {
+    if (alarm->below ? value < alarm->threshold + margin : value > alarm->threshold - margin) return;
+  } else {
+    if (alarm->below ? value >= alarm->threshold : value <= alarm->threshold) return;
+  }
+  sampler->alarmed = !sampler->alarmed;
+
+  edge.metric = report->metric;
+  strcpy(edge.id, report->id);
+  edge.breached = sampler->alarmed;
+  edge.priority = alarm->priority;
+  edge.value = value;
+  edge.threshold = alarm->threshold;
+  edge.time_taken = report->time_taken;
+  enqueue_alarm(&edge);
+}
+
+// Function adds a sample to a window, and if the window is due to close, writes its summary
+// into the report, and opens the next one. Windows stay on a fixed schedule, and close on
+// the sample closest to when they're due, like heartbeats, so a task collecting ten times
+// a window gets ten samples in every one, rather than nine or eleven. Returns whether the
+// window closed.
+int window_sample(window_t *window, int window_ms, int interval_ms, struct timespec *now, task_report_t *report, double value) {
+  double scale = report->metric == MEMORY ? 1 : NOTGIOS_WINDOW_SCALE;
+  summary_t *summary = &report->summary;
+
+  // The first sample stands for the interval before it, so it opens the window one interval
+  // back.
+  if (!window->closes.tv_sec) window->closes = add_ms(now, window_ms - interval_ms);
+  if (!window->count) {
+    window->min = value;
+    window->max = value;
+    window->sum = 0;
+  }
+  if (value < window->min) window->min = value;
+  if (value > window->max) window->max = value;
+  window->sum += value;
+  window->count++;
+  histogram_record(window->hist, value > 0 ? (uint64_t) (value * scale + 0.5) : 0);
+
+  long remaining_ms = (window->closes.tv_sec - now->tv_sec) * 1000 + (window->closes.tv_nsec - now->tv_nsec) / 1000000;
+  if (remaining_ms > interval_ms / 2) return 0;
+
+  summary->count = window->count;
+  summary->window_ms = window_ms;
+  summary->min = window->min;
+  summary->max = window->max;
+  summary->mean = window->sum / window->count;
+  summary->p50 = histogram_percentile(window->hist, 50) / scale;
+  summary->p95 = histogram_percentile(window->hist, 95) / scale;
+  summary->p99 = histogram_percentile(window->hist, 99) / scale;
+
+  // A task that was paused, or fell behind, starts over from now rather than sending a run
+  // of nearly empty windows to catch up.
+  window->closes = add_ms(&window->closes, window_ms);
+  if (remaining_ms + window_ms <= interval_ms / 2) window->closes = add_ms(now, window_ms);
+  window->count = 0;
+  histogram_clear(window->hist);
+  return 1;
+}
+
+struct timespec add_ms(struct timespec *start, int ms) {
+  struct timespec result = *start;
+  result.tv_sec += ms / 1000;
+  result.tv_nsec += (ms % 1000) * NOTGIOS_NSEC_PER_MSEC;
+  if (result.tv_nsec >= (long) NOTGIOS_NSEC_PER_SEC) {
+    result.tv_sec++;
+    result.tv_nsec -= NOTGIOS_NSEC_PER_SEC;
+  }
+  return result;
+}
+
+// Function picks out the number a report is mostly about.
+double report_signal(task_report_t *report) {
+  switch (report->metric) {
+    case MEMORY:
+      // SELF tasks carry their RSS alongside everything else.
+      return report->type == SELF ? report->rss : report->value;
+    case CPU:
+    case IO:
+      return report->percentage;
+    default:
+      // SELF tasks without a metric watch CPU, as that's what moves.
+      return report->percentage;
+  }
+}
+
+int within_band(band_t *band, double reference, double value) {
+  double width = band_width(band, reference);
+  return value - reference <= width && reference - value <= width;
+}
+
+double band_width(band_t *band, double reference) {
+  return band->percent ? (reference < 0 ? -reference : reference) * band->width / 100 : band->width;
+}
@@ -0,0 +1,26 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+/*----- Local Includes -----*/
+
+#include "monitor.h"
+#include "worker.h"
+
+/*----- Function Declarations -----*/
+
+char *parse_adaptive(char *value, adaptive_t *adaptive);
+char *parse_deadband(char *value, deadband_t *deadband);
+char *parse_window(char *value, int *window_ms);
+char *parse_alarm(char *value, alarm_t *alarm);
+int parse_band(char *value, band_t *band);
+int init_sampler(sampler_t *sampler, thread_args_t *args);
+void release_sampler(sampler_t *sampler);
+int sample_report(sampler_t *sampler, thread_args_t *args, task_report_t *report);
+void check_alarm(sampler_t *sampler, alarm_t *alarm, task_report_t *report, double value);
+int window_sample(window_t *window, int window_ms, int interval_ms, struct timespec *now, task_report_t *report, double value);
+struct timespec add_ms(struct timespec *start, int ms);
+double report_signal(task_report_t *report);
+int within_band(band_t *band, double reference, double value);
+double band_width(band_t *band, double reference);
+
+#endif
@@ -10,15 +10,15 @@
 #include <syslog.h>
 #include <pthread.h>
 #include <netinet/in.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
 #include <dirent.h>
+#include <limits.h>
 
 /*----- Local Includes -----*/
 
 #include "worker.h"
-#include "../include/hash.h"
-#include "../include/list.h"
 
 /*----- Macro Declarations -----*/
 
@@ -26,32 +26,26 @@
   do {                                                                        \
     write_log(LOG_ERR, "Task %s: Running on an unsupported distro...\n", id); \
     sprintf(report.message, "FATAL CAUSE UNSUPPORTED_DISTRO");                \
-    lpush(&reports, &report);                                                 \
+    enqueue_report(&report);                                                  \
     return NOTGIOS_TASK_FATAL;                                                \
   } while (0);
 
 /*----- Local Function Declaractions -----*/
 
 // Collection Type Handlers
-int handle_process(metric_type_t metric, task_option_t *options, char *id);
+int handle_process(metric_type_t metric, task_option_t *options, char *id, pid_t *child, unsigned int window_us);
 int handle_directory(task_option_t *options, char *id);
 int handle_disk(metric_type_t metric, task_option_t *options, char *id);
 int handle_swap(char *id);
 int handle_load(char *id);
-int handle_total(char *id, metric_type_t metric);
+int handle_total(char *id, metric_type_t metric, unsigned int window_us);
+int handle_self(self_probe_t *probe, char *id, metric_type_t metric);
 
 // Collection Functions
-int process_memory_collect(uint16_t pid, task_report_t *data);
-int process_cpu_collect(uint16_t pid, task_report_t *data);
-int process_io_collect(uint16_t pid, task_report_t *data);
-long directory_memory_collect(char *path);
-int disk_memory_collect(uint16_t pid, task_report_t *data);
-int disk_io_collect(uint16_t pid, task_report_t *data);
-int swap_collect(uint16_t pid, task_report_t *data);
-int load_collect(uint16_t pid, task_report_t *data);
-int total_memory_collect(task_report_t *data);
-int total_cpu_collect(task_report_t *data);
-int total_io_collect(task_report_t *data);
+long directory_walk(char *path, int len);
+int open_self_probe(self_probe_t *probe);
+long read_self_threads(int fd);
+int scan_process_cpu(FILE *stats, unsigned long *user, unsigned long *sys);
 
 // Utility Functions
 int check_statm();
@@ -60,17 +54,27 @@ void init_task_report(task_report_t *report, char *id, task_type_t type, metric_
 
 /*----- Evil but Necessary Globals -----*/
 
-extern hash_t threads, controls, children;
-extern list_t reports;
-extern monitor_stats_t task_stats;
-extern pthread_rwlock_t stats_lock;
+// Where collectors look for procfs, and how long they watch CPU counters for. Only ever
+// changed before any tasks start, so that benchmarks can point us at a synthetic tree.
+char *proc_root = NOTGIOS_PROC_ROOT;
+unsigned int cpu_interval_us = NOTGIOS_CPU_INTERVAL_US;
 
 /*----- Function Implementations -----*/
 
-int run_task(task_type_t type, metric_type_t metric, task_option_t *options, char *id) {
+int run_task(task_t *task) {
+  task_type_t type = task->args.type;
+  metric_type_t metric = task->args.metric;
+  task_option_t *options = task->args.options;
+  char *id = task->args.id;
+
+  // CPU collectors watch counters for a while, which can't take up more than half the
+  // task's current interval, or sub-second tasks would never keep up.
+  unsigned int window_us = cpu_interval_us;
+  if (task->sampler.interval_ms * 500U < window_us) window_us = task->sampler.interval_ms * 500U;
+
   switch (type) {
     case PROCESS:
-      return handle_process(metric, options, id);
+      return handle_process(metric, options, id, &task->child, window_us);
     case DIRECTORY:
       return handle_directory(options, id);
     case DISK:
@@ -80,20 +84,22 @@ int run_task(task_type_t type, metric_type_t metric, task_option_t *options, cha
     case LOAD:
       return handle_load(id);
     case TOTAL:
-      return handle_total(id, metric);
+      return handle_total(id, metric, window_us);
+    case SELF:
+      return handle_self(&task->self, id, metric);
     default: {
       // We've been passed an incorrectly initialized task. Shouldn't happen, but handle
       // for debugging. Plus it gets GCC off my case.
       task_report_t report;
       init_task_report(&report, id, type, metric);
       sprintf(report.message, "FATAL CAUSE INVALID_TASK");
-      lpush(&reports, &report);
+      enqueue_report(&report);
       return NOTGIOS_GENERIC_ERROR;
     }
   }
 }
 
-int handle_process(metric_type_t metric, task_option_t *options, char *id) {
+int handle_process(metric_type_t metric, task_option_t *options, char *id, pid_t *child, unsigned int window_us) {
   int keepalive = 0;
   uint16_t pid;
   char *pidfile, *runcmd;
@@ -122,7 +128,7 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
         // We've been passed a task containing invalid options. Shouldn't happen, but handle
         // it for debugging.
         sprintf(report.message, "FATAL CAUSE INVALID_TASK");
-        lpush(&reports, &report);
+        enqueue_report(&report);
         return NOTGIOS_GENERIC_ERROR;
     }
   }
@@ -137,36 +143,33 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
       // to the frontend and remove the task.
       write_log(LOG_ERR, "Task %s: Pidfile inaccessible for keepalive process...\n", id);
       sprintf(report.message, "FATAL CAUSE NO_PIDFILE");
-      lpush(&reports,  &report);
+      enqueue_report(&report);
       return NOTGIOS_TASK_FATAL;
     }
     write_log(LOG_DEBUG, "Task %s: Successfully opened pidfile for keepalive process...\n", id);
 
-    uint16_t *tmp_pid = hash_get(&children, id);
+    // The main thread clears this when it reaps the child.
+    pid_t tmp_pid = __atomic_load_n(child, __ATOMIC_ACQUIRE);
     if (tmp_pid) {
       write_log(LOG_DEBUG, "Task %s: Keepalive Process is already running...\n", id);
-      pid = *tmp_pid;
+      pid = tmp_pid;
       fprintf(file, "%hu", pid);
     } else {
       pid = fork();
       if (pid) {
         write_log(LOG_DEBUG, "Task %s: Forked...\n", id);
-        uint16_t *pid_cpy = malloc(sizeof(uint16_t));
-        *pid_cpy = pid;
 
-        // Put the new pid into the children hash, update the pidfile, and just make
-        // sure we aren't doing all of this for nothing.
-        int retval = hash_put(&children, id, pid_cpy);
+        // Record the new pid so the SIGCHLD handler can find us, and update the pidfile.
+        __atomic_store_n(child, pid, __ATOMIC_RELEASE);
         fprintf(file, "%hu", pid);
-        if (retval == HASH_FROZEN) return NOTGIOS_IN_SHUTDOWN;
       } else {
         int elem = 0;
         char *args[NOTGIOS_MAX_ARGS];
         memset(args, 0, sizeof(char *) * NOTGIOS_MAX_ARGS);
 
-        // Just sleep for a tiny bit to make sure our pid got into the children table.
+        // Just sleep for a tiny bit to make sure our pid got into the task table.
         // No validation has been done on the run command, so, odds are, it won't work
-        // and exec will fail. If so, need to make sure our pid is in the children table
+        // and exec will fail. If so, need to make sure our pid is in the task table
         // so that the SIGCHLD handler will know what to do with our exit status.
         sleep(0.1);
 
@@ -174,6 +177,12 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
         char *path = strtok(runcmd, "\t"), *arg;
         while ((arg = strtok(NULL, "\t")) && elem < NOTGIOS_MAX_ARGS) args[elem++] = arg;
 
+        // The monitor keeps SIGCHLD and SIGTERM blocked for its signalfd, and the mask
+        // survives exec, so give the child a clean slate.
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
         // Moment of truth!
         execv(path, args);
         exit(NOTGIOS_EXEC_FAILED);
@@ -200,14 +209,14 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
           // The process is not currently running, enqueue a report saying this, then return.
           write_log(LOG_ERR, "Task %s: Kill revealed watched process is not running...\n", id);
           sprintf(report.message, "ERROR CAUSE PROC_NOT_RUNNING");
-          lpush(&reports, &report);
+          enqueue_report(&report);
           return NOTGIOS_SUCCESS;
         }
       } else {
         // The process is not currently running, enqueue a report saying this, then return.
         write_log(LOG_ERR, "Task %s: Pidfile not formatted correctly for watched process...\n", id);
         sprintf(report.message, "ERROR CAUSE PROC_NOT_RUNNING");
-        lpush(&reports, &report);
+        enqueue_report(&report);
         return NOTGIOS_SUCCESS;
       }
     } else {
@@ -215,7 +224,7 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
       // send a message to the frontend, and then remove the task.
       write_log(LOG_ERR, "Task %s: Pidfile not accessible for watched process...\n", id);
       sprintf(report.message, "FATAL CAUSE NO_PIDFILE");
-      lpush(&reports, &report);
+      enqueue_report(&report);
       return NOTGIOS_TASK_FATAL;
     }
   }
@@ -244,7 +253,7 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
       }
       break;
     case CPU:
-      retval = process_cpu_collect(pid, &report);
+      retval = process_cpu_collect(pid, &report, window_us);
       if (retval == NOTGIOS_NOPROC) {
         if (check_stat()) {
           write_log(LOG_ERR, "Task %s: Watched/Keepalive process is not running for collection...\n", id);
@@ -270,20 +279,20 @@ int handle_process(metric_type_t metric, task_option_t *options, char *id) {
       // We've been passed a task containing invalid options. Shouldn't happen, but handle it
       // for debugging.
       sprintf(report.message, "FATAL CAUSE INVALID_TASK");
-      lpush(&reports, &report);
+      enqueue_report(&report);
       return NOTGIOS_GENERIC_ERROR;
   }
 
   if (retval == NOTGIOS_UNSUPP_TASK) {
-    write_log(LOG_DEBUG, "Task %s: Received an unsupported task. Removing...");
+    write_log(LOG_DEBUG, "Task %s: Received an unsupported task. Removing...\n", id);
     sprintf(report.message, "FATAL CAUSE UNSUPPORTED_TASK");
-    lpush(&reports, &report);
+    enqueue_report(&report);
     return NOTGIOS_TASK_FATAL;
   }
 
   // Enqueue metrics for sending.
   write_log(LOG_DEBUG, "Task %s: Enqueuing report and returning...\n", id);
-  lpush(&reports, &report);
+  enqueue_report(&report);
   return NOTGIOS_SUCCESS;
 }
 
@@ -306,7 +315,7 @@ int handle_directory(task_option_t *options, char *id) {
         // We've been passed a task containing invalid options. Shouldn't happen, but handle
         // it for debugging.
         sprintf(report.message, "FATAL CAUSE INVALID_TASK");
-        lpush(&reports, &report);
+        enqueue_report(&report);
         return NOTGIOS_GENERIC_ERROR;
     }
   }
@@ -318,7 +327,7 @@ int handle_directory(task_option_t *options, char *id) {
     // wasn't sent.
     write_log(LOG_ERR, "Task %s: Recevied directory task with no path option...\n", id);
     sprintf(report.message, "FATAL CAUSE TASK_MISSING_OPTIONS");
-    lpush(&reports, &report);
+    enqueue_report(&report);
     return NOTGIOS_TASK_FATAL;
   } else if (access(path, F_OK)) {
     // We can't access the directory for some reason.
@@ -327,7 +336,7 @@ int handle_directory(task_option_t *options, char *id) {
     else if (errno == ELOOP) sprintf(report.message, "FATAL CAUSE DIR_INFINITE_LOOP");
     else if (errno == ENAMETOOLONG) sprintf(report.message, "FATAL CAUSE DIR_NAME_TOO_LONG");
     else sprintf(report.message, "FATAL CAUSE UNKNOWN");
-    lpush(&reports, &report);
+    enqueue_report(&report);
     return NOTGIOS_TASK_FATAL;
   }
 
@@ -336,11 +345,11 @@ int handle_directory(task_option_t *options, char *id) {
   long retval = directory_memory_collect(path);
   if (retval >= 0) {
     report.value = (double) retval;
-    report.time_taken = time(NULL);
+    clock_gettime(CLOCK_REALTIME, &report.time_taken);
   } else if (retval == NOTGIOS_BAD_ACCESS) {
     write_log(LOG_ERR, "Task %s: Access was refused for a subdirectory...\n", id);
     sprintf(report.message, "FATAL CAUSE SUBDIR_NOT_ACCESSIBLE");
-    lpush(&reports, &report);
+    enqueue_report(&report);
     return NOTGIOS_TASK_FATAL;
   } else if (retval == NOTGIOS_NO_FILES) {
     write_log(LOG_ERR, "Task %s: Failed to open a file due to too many files being open...\n", id);
@@ -349,7 +358,7 @@ int handle_directory(task_option_t *options, char *id) {
 
   // Enqueue metrics for sending.
   write_log(LOG_DEBUG, "Task %s: Enqueuing report and returning...\n", id);
-  lpush(&reports, &report);
+  enqueue_report(&report);
   return NOTGIOS_SUCCESS;
 }
 
@@ -365,7 +374,7 @@ int handle_load(char *id) {
   // TODO: Write this function.
 }
 
-int handle_total(char *id, metric_type_t metric) {
+int handle_total(char *id, metric_type_t metric, unsigned int window_us) {
   task_report_t report;
   init_task_report(&report, id, PROCESS, metric);
 
@@ -377,7 +386,7 @@ int handle_total(char *id, metric_type_t metric) {
       write_log(LOG_DEBUG, "Task %s: Total memory info collected...\n", id);
       break;
     case CPU:
-      retval = total_cpu_collect(&report);
+      retval = total_cpu_collect(&report, window_us);
       if (retval == NOTGIOS_UNSUPP_DISTRO) RETURN_UNSUPPORTED_DISTRO(report, id);
       write_log(LOG_DEBUG, "Task %s: Total CPU usage collected...\n", id);
       break;
@@ -389,32 +398,47 @@ int handle_total(char *id, metric_type_t metric) {
       // We've been passed a task containing invalid options. Shouldn't happen, but handle it
       // for debugging.
       sprintf(report.message, "FATAL CAUSE INVALID_TASK");
-      lpush(&reports, &report);
+      enqueue_report(&report);
       return NOTGIOS_GENERIC_ERROR;
   }
 
   if (retval == NOTGIOS_UNSUPP_TASK) {
     write_log(LOG_DEBUG, "Task %s: Received an unsupported task. Removing...\n", id);
     sprintf(report.message, "FATAL CAUSE UNSUPPORTED_TASK");
-    lpush(&reports, &report);
+    enqueue_report(&report);
     return NOTGIOS_TASK_FATAL;
   }
 
   write_log(LOG_DEBUG, "Task %s: Enqueuing report an returning...\n", id);
-  lpush(&reports, &report);
+  enqueue_report(&report);
+  return NOTGIOS_SUCCESS;
+}
+
+// Function reports on the monitor itself, so that what we cost to run on a host is tracked
+// like anything else. Reports always carry every number, the metric only says which one
+// options like ALARM watch.
+int handle_self(self_probe_t *probe, char *id, metric_type_t metric) {
+  task_report_t report;
+  init_task_report(&report, id, SELF, metric);
+
+  if (self_collect(probe, &report) == NOTGIOS_UNSUPP_DISTRO) RETURN_UNSUPPORTED_DISTRO(report, id);
+  write_log(LOG_DEBUG, "Task %s: Monitor overhead collected...\n", id);
+
+  enqueue_report(&report);
   return NOTGIOS_SUCCESS;
 }
 
 int process_memory_collect(uint16_t pid, task_report_t *data) {
-  char path[NOTGIOS_MAX_PROC_LEN];
-  sprintf(path, "/proc/%hu/statm", pid);
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/%hu/statm", proc_root, pid);
   FILE *statm = fopen(path, "r");
   if (statm) {
     long usage;
     int retval = fscanf(statm, "%ld", &usage);
+    fclose(statm);
     if (retval == 1) {
       data->value = (double) usage;
-      data->time_taken = time(NULL);
+      clock_gettime(CLOCK_REALTIME, &data->time_taken);
       return NOTGIOS_SUCCESS;
     } else {
       return NOTGIOS_NOPROC;
@@ -429,19 +453,20 @@ int process_memory_collect(uint16_t pid, task_report_t *data) {
 // Currently uses the /proc pseudo-filesystem, which means that it's somewhat architecture independent,
 // (certainly Linux only) but all of the reading I've done on this makes this sound like pretty much
 // the only option.
-int process_cpu_collect(uint16_t pid, task_report_t *data) {
+int process_cpu_collect(uint16_t pid, task_report_t *data, unsigned int window_us) {
   unsigned long start_pid_user, end_pid_user, start_pid_sys, end_pid_sys, start_pid_total, end_pid_total;
   unsigned long start_user, end_user, start_nice, end_nice, start_sys, end_sys, start_idle, end_idle, start_io, end_io;
   unsigned long start_global_total, end_global_total;
   int retvals[2];
-  char path[NOTGIOS_MAX_PROC_LEN];
+  char path[PATH_MAX], global_path[PATH_MAX];
 
   // Need to get systemwide, and per process, CPU information from /proc filesystem.
   // I know that this isn't guaranteed to work on every system, but at least most Linuxes seem to agree on the
   // format for per process stat files, and that the first line of /proc/stat should be used for total CPU stats.
-  sprintf(path, "/proc/%hu/stat", pid);
+  snprintf(path, PATH_MAX, "%s/%hu/stat", proc_root, pid);
+  snprintf(global_path, PATH_MAX, "%s/stat", proc_root);
   FILE *pid_stats = fopen(path, "r");
-  FILE *global_stats = fopen("/proc/stat", "r");
+  FILE *global_stats = fopen(global_path, "r");
 
   // Perform some error checking here.
   // Process specific proc files only exist while their processes are running. If the process
@@ -462,7 +487,7 @@ int process_cpu_collect(uint16_t pid, task_report_t *data) {
   // The call we've all been waiting for!
   // Get the processor times the first time.
   // The stars in the format strings represent that the value exists but that we're not interested in it.
-  retvals[0] = fscanf(pid_stats, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*lu %*lu %*lu %*lu %lu %lu", &start_pid_user, &start_pid_sys);
+  retvals[0] = scan_process_cpu(pid_stats, &start_pid_user, &start_pid_sys);
   retvals[1] = fscanf(global_stats, "%*s %lu %lu %lu %lu %lu", &start_user, &start_nice, &start_sys, &start_idle, &start_io);
   fclose(pid_stats);
   fclose(global_stats);
@@ -472,12 +497,12 @@ int process_cpu_collect(uint16_t pid, task_report_t *data) {
   start_pid_total = start_pid_user + start_pid_sys;
   start_global_total = start_user + start_nice + start_sys + start_idle + start_io;
 
-  // Sleep for a second and get updated statistics.
-  sleep(1);
+  // Let the counters move for a while and get updated statistics.
+  usleep(window_us);
 
   // Reopen files for new values.
   pid_stats = fopen(path, "r");
-  global_stats = fopen("/proc/stat", "r");
+  global_stats = fopen(global_path, "r");
 
   // If we've made it this far, we know we're running a supported distro, but the process could
   // have crashed in the last second, so we need to check that again.
@@ -487,7 +512,7 @@ int process_cpu_collect(uint16_t pid, task_report_t *data) {
   }
 
   // Get the updated processor times.
-  retvals[0] = fscanf(pid_stats, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*lu %*lu %*lu %*lu %lu %lu", &end_pid_user, &end_pid_sys);
+  retvals[0] = scan_process_cpu(pid_stats, &end_pid_user, &end_pid_sys);
   retvals[1] = fscanf(global_stats, "%*s %lu %lu %lu %lu %lu", &end_user, &end_nice, &end_sys, &end_idle, &end_io);
   fclose(pid_stats);
   fclose(global_stats);
@@ -499,7 +524,7 @@ int process_cpu_collect(uint16_t pid, task_report_t *data) {
 
   // Perform the calculation.
   data->percentage = (end_pid_total - start_pid_total) * 100 / (double) (end_global_total - start_global_total);
-  data->time_taken = time(NULL);
+  clock_gettime(CLOCK_REALTIME, &data->time_taken);
 
   return NOTGIOS_SUCCESS;
 }
@@ -513,8 +538,19 @@ int process_io_collect(uint16_t pid, task_report_t *data) {
 }
 
 long directory_memory_collect(char *path) {
+  // Every entry's path gets built up in place in this one buffer as we go.
+  char buffer[PATH_MAX];
+  int len = strlen(path);
+  if (len >= PATH_MAX) return NOTGIOS_BAD_ACCESS;
+  memcpy(buffer, path, len + 1);
+  return directory_walk(buffer, len);
+}
+
+// Function recursively sums the size of everything under path. path must point into a
+// PATH_MAX buffer, and is put back the way it was found before returning.
+long directory_walk(char *path, int len) {
   struct stat path_stat;
-  stat(path, &path_stat);
+  if (stat(path, &path_stat)) return 0;
 
   if (S_ISDIR(path_stat.st_mode)) {
     // We're working with a directory. Time to recursively calculate its size.
@@ -526,15 +562,21 @@ long directory_memory_collect(char *path) {
       for (struct dirent *entry = readdir(directory); entry; entry = readdir(directory)) {
         // Skip the parent and current directory.
         if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
-          // Recursively calculate size of entry.
-          char *filename = malloc(sizeof(char) * (strlen(path) + strlen(entry->d_name) + 2));
-          sprintf(filename, "%s/%s", path, entry->d_name);
-          long retval = directory_memory_collect(filename);
-          free(filename);
+          // Recursively calculate size of entry. Anything too deep to name gets skipped.
+          int entry_len = strlen(entry->d_name);
+          if (len + entry_len + 2 > PATH_MAX) continue;
+          path[len] = '/';
+          memcpy(path + len + 1, entry->d_name, entry_len + 1);
+          long retval = directory_walk(path, len + entry_len + 1);
+          path[len] = '\0';
 
           // Increment size and keep going.
-          if (retval >= 0) size += retval;
-          else return retval;
+          if (retval >= 0) {
+            size += retval;
+          } else {
+            closedir(directory);
+            return retval;
+          }
         }
       }
       closedir(directory);
@@ -550,7 +592,7 @@ long directory_memory_collect(char *path) {
         fd_limits.rlim_max *= 2;
         fd_limits.rlim_cur = fd_limits.rlim_max;
         int retval = setrlimit(RLIMIT_NOFILE, &fd_limits);
-        if (!retval) return directory_memory_collect(path);
+        if (!retval) return directory_walk(path, len);
         else return NOTGIOS_NO_FILES;
       } else if (errno == ENFILE) {
         return NOTGIOS_NO_FILES;
@@ -584,7 +626,9 @@ int load_collect(uint16_t pid, task_report_t *data) {
 
 int total_memory_collect(task_report_t *data) {
   // Open the proc file for memory usage.
-  FILE *mem_stats = fopen("/proc/meminfo", "r");
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/meminfo", proc_root);
+  FILE *mem_stats = fopen(path, "r");
   long mem_total, mem_available;
   if (!mem_stats) return NOTGIOS_UNSUPP_DISTRO;
 
@@ -598,13 +642,16 @@ int total_memory_collect(task_report_t *data) {
   if (retval != 2) return NOTGIOS_UNSUPP_DISTRO;
 
   data->percentage = mem_available / (double) mem_total;
-  data->time_taken = time(NULL);
+  data->value = (mem_total - mem_available) * 1024.0;
+  clock_gettime(CLOCK_REALTIME, &data->time_taken);
   return NOTGIOS_SUCCESS;
 }
 
-int total_cpu_collect(task_report_t *data) {
+int total_cpu_collect(task_report_t *data, unsigned int window_us) {
   unsigned long start_user, end_user, start_nice, end_nice, start_sys, end_sys, start_idle, end_idle, start_io, end_io;
-  FILE *cpu_stats = fopen("/proc/stat", "r");
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/stat", proc_root);
+  FILE *cpu_stats = fopen(path, "r");
   if (!cpu_stats) return NOTGIOS_UNSUPP_DISTRO;
 
   // Get the initial values.
@@ -615,12 +662,14 @@ int total_cpu_collect(task_report_t *data) {
   }
   fclose(cpu_stats);
 
-  // Sleep for a second.
-  sleep(1);
+  // Let the counters move for a while.
+  usleep(window_us);
 
   // Get the final values.
-  cpu_stats = fopen("/proc/stat", "r");
+  cpu_stats = fopen(path, "r");
+  if (!cpu_stats) return NOTGIOS_UNSUPP_DISTRO;
   retval = fscanf(cpu_stats, "%*s %lu %lu %lu %lu %lu", &end_user, &end_nice, &end_sys, &end_idle, &end_io);
+  fclose(cpu_stats);
   if (retval != 5) return NOTGIOS_UNSUPP_DISTRO;
 
   // Perform the calculation.
@@ -629,7 +678,7 @@ int total_cpu_collect(task_report_t *data) {
   unsigned long end_total = end_user + end_nice + end_sys + end_idle + end_io;
   unsigned long total_delta = end_total - start_total;
   data->percentage = 100 * (total_delta - (end_idle_total - start_idle_total)) / (double) total_delta;
-  data->time_taken = time(NULL);
+  clock_gettime(CLOCK_REALTIME, &data->time_taken);
   
   return NOTGIOS_SUCCESS;
 }
@@ -639,17 +688,113 @@ int total_io_collect(task_report_t *data) {
   return NOTGIOS_UNSUPP_TASK;
 }
 
+// Function samples the monitor's own footprint. Everything comes from getrusage or from proc
+// files that stay open between samples, so a sample costs a handful of syscalls. CPU percent
+// is since the previous sample, and is left at zero on the first one.
+int self_collect(self_probe_t *probe, task_report_t *data) {
+  char buf[NOTGIOS_STATIC_BUFSIZE];
+  struct rusage usage;
+  struct timespec now;
+  long pages;
+
+  if (open_self_probe(probe) != NOTGIOS_SUCCESS) return NOTGIOS_UNSUPP_DISTRO;
+
+  // CPU time and context switches, summed over every thread we've got.
+  getrusage(RUSAGE_SELF, &usage);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long cpu_usec = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  if (probe->taken.tv_sec || probe->taken.tv_nsec) {
+    long wall_usec = (now.tv_sec - probe->taken.tv_sec) * 1000000L + (now.tv_nsec - probe->taken.tv_nsec) / 1000;
+    if (wall_usec > 0) data->percentage = 100 * (cpu_usec - probe->cpu_usec) / (double) wall_usec;
+  }
+  probe->cpu_usec = cpu_usec;
+  probe->taken = now;
+  data->value = cpu_usec / 1000000.0;
+  data->switches = usage.ru_nvcsw + usage.ru_nivcsw;
+
+  // Resident set size.
+  int len = pread(probe->statm_fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) return NOTGIOS_UNSUPP_DISTRO;
+  buf[len] = '\0';
+  if (sscanf(buf, "%*d %ld", &pages) != 1) return NOTGIOS_UNSUPP_DISTRO;
+  data->rss = pages * sysconf(_SC_PAGESIZE);
+
+  // Thread count.
+  data->threads = read_self_threads(probe->stat_fd);
+  if (data->threads < 0) return NOTGIOS_UNSUPP_DISTRO;
+
+  // Open file descriptors, not counting the directory handle we're reading them through.
+  struct dirent *entry;
+  long fds = 0;
+  rewinddir(probe->fd_dir);
+  while ((entry = readdir(probe->fd_dir))) {
+    if (entry->d_name[0] != '.') fds++;
+  }
+  data->fds = fds - 1;
+
+  clock_gettime(CLOCK_REALTIME, &data->time_taken);
+  return NOTGIOS_SUCCESS;
+}
+
+// Function opens whatever proc files the probe doesn't have open yet. These always come from
+// the real /proc, whatever proc_root says, since they're about us.
+int open_self_probe(self_probe_t *probe) {
+  if (probe->statm_fd < 0) probe->statm_fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  if (probe->stat_fd < 0) probe->stat_fd = open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+  if (!probe->fd_dir) probe->fd_dir = opendir("/proc/self/fd");
+  if (probe->statm_fd < 0 || probe->stat_fd < 0 || !probe->fd_dir) return NOTGIOS_UNSUPP_DISTRO;
+  return NOTGIOS_SUCCESS;
+}
+
+// Function pulls the thread count out of /proc/self/stat. The command name can contain spaces
+// and parentheses, so fields are counted from the last closing parenthesis.
+long read_self_threads(int fd) {
+  char buf[NOTGIOS_STATIC_BUFSIZE * 2];
+  long threads;
+
+  int len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) return -1;
+  buf[len] = '\0';
+  char *fields = strrchr(buf, ')');
+  if (!fields) return -1;
+
+  // Thread count is the 20th field, and the 18th after the command name.
+  int retval = sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %ld", &threads);
+  return retval == 1 ? threads : -1;
+}
+
+// Function pulls a process's user and system CPU times out of its stat file. Like
+// read_self_threads, fields are counted from the last closing parenthesis, as the command
+// name can contain spaces and parentheses of its own. Returns how many of the two it found.
+int scan_process_cpu(FILE *stats, unsigned long *user, unsigned long *sys) {
+  char buf[NOTGIOS_STATIC_BUFSIZE * 2];
+
+  int len = fread(buf, 1, sizeof(buf) - 1, stats);
+  buf[len > 0 ? len : 0] = '\0';
+  char *fields = strrchr(buf, ')');
+  if (!fields) return 0;
+
+  // User and system time are the 14th and 15th fields, the 12th and 13th after the name.
+  int retval = sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", user, sys);
+  return retval < 0 ? 0 : retval;
+}
+
 // Function checks whether or not it's possible to access memory statistics for our own process.
 // If not, means that whatever distro we're running on doesn't support it.
 int check_statm() {
-  return !access("/proc/self/statm", F_OK);
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/self/statm", proc_root);
+  return !access(path, F_OK);
 }
 
 // Function checks whether or not we can parse the CPU statistics for our own process.
 // If not, means that whatever distro we're running on doesn't use a format we support.
 int check_stat() {
-  FILE *stats = fopen("/proc/self/stat", "r");
-  FILE *global_stats = fopen("/proc/stat", "r");
+  char path[PATH_MAX], global_path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/self/stat", proc_root);
+  snprintf(global_path, PATH_MAX, "%s/stat", proc_root);
+  FILE *stats = fopen(path, "r");
+  FILE *global_stats = fopen(global_path, "r");
   if (stats && global_stats) {
     int retvals[2], supported = 0;
     unsigned long pid_user, pid_sys, global_user, global_nice, global_sys, global_idle;
@@ -662,14 +807,27 @@ int check_stat() {
     fclose(global_stats);
     fclose(stats);
     return supported;
-  } else if (!stats) {
+  } else if (global_stats) {
     fclose(global_stats);
-  } else if (!global_stats) {
+  } else if (stats) {
     fclose(stats);
   }
   return 0;
 }
 
+void init_self_probe(self_probe_t *probe) {
+  memset(probe, 0, sizeof(self_probe_t));
+  probe->statm_fd = -1;
+  probe->stat_fd = -1;
+}
+
+void release_self_probe(self_probe_t *probe) {
+  if (probe->statm_fd >= 0) close(probe->statm_fd);
+  if (probe->stat_fd >= 0) close(probe->stat_fd);
+  if (probe->fd_dir) closedir(probe->fd_dir);
+  init_self_probe(probe);
+}
+
 void init_task_report(task_report_t *report, char *id, task_type_t type, metric_type_t metric) {
   if (report) {
     memset(report->id, 0, sizeof(char) * NOTGIOS_MAX_NUM_LEN);
@@ -678,7 +836,14 @@ void init_task_report(task_report_t *report, char *id, task_type_t type, metric_
     strcpy(report->id, id);
     report->percentage = 0;
     report->value = 0;
+    report->rss = 0;
+    report->threads = 0;
+    report->fds = 0;
+    report->switches = 0;
+    report->interval_ms = 0;
+    report->summary.count = 0;
     report->type = type;
     report->metric = metric;
+    clock_gettime(CLOCK_REALTIME, &report->time_taken);
   }
 }
@@ -13,16 +13,59 @@
 
 /*----- Type Declaractions -----*/
 
+// Struct summarizes every sample a windowed task collected over its last window. Count is
+// zero for reports that aren't from one.
+typedef struct summary {
+  long count;
+  int window_ms;
+  double min, max, mean, p50, p95, p99;
+} summary_t;
+
 typedef struct task_report {
   task_type_t type;
   metric_type_t metric;
   char id[NOTGIOS_MAX_NUM_LEN], message[NOTGIOS_ERROR_BUFSIZE];
   double percentage, value;
-  time_t time_taken;
+  long rss, threads, fds, switches;
+  int interval_ms;
+  summary_t summary;
+  struct timespec time_taken;
 } task_report_t;
 
+// Struct represents a task's value crossing its alarm threshold, one way or the other.
+typedef struct alarm_report {
+  metric_type_t metric;
+  char id[NOTGIOS_MAX_NUM_LEN];
+  int breached, priority;
+  double value, threshold;
+  struct timespec time_taken;
+} alarm_report_t;
+
+/*----- Evil but Necessary Globals -----*/
+
+extern char *proc_root;
+extern unsigned int cpu_interval_us;
+
 /*----- Function Declarations -----*/
 
-int run_task(task_type_t type, metric_type_t metric, task_option_t *options, char *id);
+int run_task(task_t *task);
+void enqueue_report(task_report_t *report);
+void enqueue_alarm(alarm_report_t *alarm);
+
+// Collection Functions
+int process_memory_collect(uint16_t pid, task_report_t *data);
+int process_cpu_collect(uint16_t pid, task_report_t *data, unsigned int window_us);
+int process_io_collect(uint16_t pid, task_report_t *data);
+long directory_memory_collect(char *path);
+int disk_memory_collect(uint16_t pid, task_report_t *data);
+int disk_io_collect(uint16_t pid, task_report_t *data);
+int swap_collect(uint16_t pid, task_report_t *data);
+int load_collect(uint16_t pid, task_report_t *data);
+int total_memory_collect(task_report_t *data);
+int total_cpu_collect(task_report_t *data, unsigned int window_us);
+int total_io_collect(task_report_t *data);
+int self_collect(self_probe_t *probe, task_report_t *data);
+void init_self_probe(self_probe_t *probe);
+void release_self_probe(self_probe_t *probe);
 
 #endif
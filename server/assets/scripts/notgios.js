@@ -148,14 +148,14 @@ notgios.controller('taskController', ['$scope', '$interval', 'authenticated', fu
         var subset = response.data.slice(0, found);
         var key;
         for (var k in subset[0]) {
-          if (subset[0].hasOwnProperty(k) && k != 'timestamp') {
+          if (subset[0].hasOwnProperty(k) && k != 'timestamp' && k != 'nsec') {
             key = k;
             break;
           }
         }
         for (var i = 0; i < subset.length; i++) {
           var point = subset[i];
-          series.addPoint([point.timestamp * 1000, parseInt(point[key])]);
+          series.addPoint([point.timestamp * 1000 + (point.nsec || 0) / 1000000, parseInt(point[key])]);
         }
       }
       $scope.metrics = response.data;
@@ -1,3 +1,6 @@
+require 'securerandom'
+require 'set'
+
 module Notgios
   module Connection
 
@@ -6,7 +9,10 @@ module Notgios
     # tasks - Array of CommandStructs
     # queue - Queue
     # address - String
-    MonitorStruct = Struct.new(:socket, :tasks, :queue, :address)
+    # session - String, nil for monitors that don't support sessions
+    # acked - Integer, highest sequence number we've seen every report up to in this session
+    # seen - Set of Integers, sequence numbers past acked that we've already handled
+    MonitorStruct = Struct.new(:socket, :tasks, :queue, :address, :session, :acked, :seen)
 
     class MiddleMan
 
@@ -59,7 +65,91 @@ module Notgios
       # to make sure this can't happen.
       SUPERVISOR_SLEEP_PERIOD = KEEPALIVE_TIME / 2
 
-      def send_command(socket, cmd)
+      # Largest number of adds we'll pack into a single batch. Worst case task definitions
+      # are around half a kilobyte, and the monitor caps frames at 256KB.
+      BATCH_SIZE = 256
+
+      # Sends everything currently queued up for a monitor. Runs of adds, like the full task
+      # list we send when a monitor first connects, go out as batches so that they only cost
+      # a single round trip each.
+      def send_commands(socket, command_queue, monitor, nodis)
+        pending = Array.new
+        pending.push(command_queue.pop) until command_queue.empty?
+
+        pending.slice_when { |prev, curr| prev.command.to_sym != :add || curr.command.to_sym != :add }.each do |run|
+          if run.size > 1 && run.first.command.to_sym == :add
+            run.each_slice(BATCH_SIZE) { |batch| send_batch(socket, batch, monitor, nodis) }
+          else
+            run.each { |cmd| send_command(socket, cmd, monitor, nodis) }
+          end
+        end
+      end
+
+      def send_batch(socket, cmds, monitor, nodis)
+        @logger.debug("MiddleMan Handler: Sending a batch of #{cmds.size} add commands...")
+        lines = ['NGS JOB ADD BATCH']
+        cmds.each { |cmd| lines.concat(add_lines(cmd).drop(1)).push('END') }
+
+        # Batches are big enough that a nonblocking write could come up short.
+        socket.write(lines, false)
+
+        # Reply has a line per task, in the order we sent them, of the form "ID <id> ACK" or
+        # "ID <id> NACK <cause>". COUNT says how many tasks it covers. The monitor doesn't
+        # start anything it couldn't answer for, so whatever's left over goes out again.
+        message = read_reply(socket, monitor, nodis)
+        if message.first == 'NGS BATCH REPLY'
+          count = message[1].scan(/\d+/).first.to_i
+          message.drop(2).take(count).each do |line|
+            _, id, status, cause = line.split(' ')
+            next unless status == 'NACK'
+            @logger.error("MiddleMan Handler: Received a NACK for task #{id} in batch, enqueuing...")
+            @error_queue.push(ErrorStruct.new(id.to_i, cause, :nack))
+          end
+
+          unanswered = cmds.drop(count)
+          if unanswered.empty?
+            return
+          elsif count.zero?
+            @logger.error('MiddleMan Handler: Monitor answered none of a batch, enqueuing...')
+            unanswered.each { |cmd| @error_queue.push(ErrorStruct.new(cmd.id, 'BATCH_TRUNCATED', :nack)) }
+          else
+            @logger.info("MiddleMan Handler: Monitor only answered #{count} tasks in batch, resending the rest...")
+            send_batch(socket, unanswered, monitor, nodis)
+          end
+        else
+          # Whole batch was rejected.
+          @logger.error('MiddleMan Handler: Received a NACK for batch, enqueuing...')
+          cause = message[1].scan(/\w+/)[1]
+          cmds.each { |cmd| @error_queue.push(ErrorStruct.new(cmd.id, cause, :nack)) }
+        end
+      end
+
+      def add_lines(cmd)
+        [
+          "NGS JOB ADD",
+          "ID #{cmd.id}",
+          "TYPE #{cmd.type.upcase}",
+          "METRIC #{cmd.metric.upcase}",
+          "FREQ #{cmd.freq}"
+        ].concat(cmd.options)
+      end
+
+      # Reads the reply to whatever we just sent.
+      # Don't bother handling the potential exception here, let our calling method take
+      # care of it.
+      def read_reply(socket, monitor, nodis)
+        message = socket.read
+
+        # Monitors send reports and alarms as soon as they're collected, so they can show up
+        # before our reply does. Hand those off until we find it.
+        while ['NGS JOB REPORT', 'NGS JOB ALARM'].include?(message.first)
+          handle_monitor_message(message, monitor, nodis)
+          message = socket.read
+        end
+        message
+      end
+
+      def send_command(socket, cmd, monitor, nodis)
         valid = true
 
         # Send command to monitor.
@@ -67,13 +157,7 @@ module Notgios
         case cmd.command.to_sym
         when :add
           @logger.debug('MiddleMan Handler: Sending an add command...')
-          socket.write([
-            "NGS JOB ADD",
-            "ID #{cmd.id}",
-            "TYPE #{cmd.type.upcase}",
-            "METRIC #{cmd.metric.upcase}",
-            "FREQ #{cmd.freq}"
-          ].concat(cmd.options))
+          socket.write(add_lines(cmd))
         when :pause
           @logger.debug('MiddleMan Handler: Sending a pause command...')
           socket.write([
@@ -101,9 +185,7 @@ module Notgios
 
         # Get the response from the monitor.
         if valid
-          # Don't bother handling the potential exception here, let our calling method take
-          # care of it.
-          message = socket.read
+          message = read_reply(socket, monitor, nodis)
           if message.first == 'NGS NACK'
             # NACKs can only be sent during adds, so something went wrong. Enqueue it to let the
             # server know.
@@ -119,7 +201,7 @@ module Notgios
       # Method handles sending metrics to their appropriate list in Redis, and responding to
       # any errors.
       def handle_monitor_message(message, monitor, nodis)
-        unless message.first == 'NGS JOB REPORT'
+        unless ['NGS JOB REPORT', 'NGS JOB ALARM'].include?(message.first)
           # We've received an invalid job report. Shouldn't ever happen, but hey, the Apollo 13
           # near catastrophe was caused by a supposedly impossible quadruple failure on the regulator
           # of an oxygen canister. Shit happens. Log it, move on.
@@ -128,7 +210,27 @@ module Notgios
         end
 
         id = message[1].scan(/\d+/).first.to_i
-        if message[3].index('FATAL').exists? || message[3].index('ERROR').exists?
+
+        # Monitors that are in a session number their reports, and will resend anything we
+        # haven't acknowledged after a reconnect. Skip anything we've already handled.
+        seq = message.map { |line| line.scan(/\ASEQ (\d+)/).first }.compact.first
+        if seq.exists? && !record_seq(monitor, seq.first.to_i)
+          @logger.debug("MiddleMan Handler: Already handled report #{seq.first}, skipping...")
+          return
+        end
+
+        if message.first == 'NGS JOB ALARM'
+          # Monitors evaluate alarms themselves, and only tell us when one goes off or clears.
+          @logger.info("MiddleMan Handler: Monitor sent an alarm for task #{id}, enqueuing...")
+          begin
+            nodis.post_job_alarm(id, message.slice(2..-1))
+          rescue Nodis::InvalidJobError
+            @logger.error('MiddleMan Handler: Invalid job alarm, dumping...')
+            @logger.error(message.inspect)
+          rescue Nodis::NoSuchResourceError
+            @logger.debug('MiddleMan Handler: Task has been removed, but monitor hasn\'t been notified yet. Dumping alarm...')
+          end
+        elsif message[3].index('FATAL').exists? || message[3].index('ERROR').exists?
           # We've encountered an error. Push it onto the error queue, remove if necessary, and move on.
           if message[3].index('FATAL').exists?
             severity = :fatal
@@ -161,6 +263,26 @@ module Notgios
         end
       end
 
+      # Most reports a monitor will hold on to for us, matching NOTGIOS_UNACKED_MAX. Anything
+      # missing further back than that is never coming, so there's no point waiting on it.
+      UNACKED_MAX = 4096
+
+      # Records that we've handled report seq. ACKED tells the monitor it can forget everything
+      # up to it, so it only moves past reports we've actually seen, and a gap holds it back
+      # until the missing report turns up. Returns false if we've handled seq before.
+      def record_seq(monitor, seq)
+        monitor.acked ||= 0
+        monitor.seen ||= Set.new
+        return false if seq <= monitor.acked || !monitor.seen.add?(seq)
+
+        if monitor.seen.size > UNACKED_MAX
+          @logger.error("MiddleMan Handler: Gave up waiting on report #{monitor.acked + 1}...")
+          monitor.acked = monitor.seen.min - 1
+        end
+        monitor.acked += 1 while monitor.seen.delete?(monitor.acked + 1)
+        true
+      end
+
       # This method starts the individual monitor handling threads.
       # These threads handle all communication with the monitors after the initial handshake
       # is completed.
@@ -185,8 +307,14 @@ module Notgios
               until Thread.current[:should_halt].exists?
                 if Time.now - keepalive_timer >= KEEPALIVE_TIME
                   # It's time to send a keepalive message!
+                  # Piggyback our acknowledgement of the monitor's reports, so it can stop
+                  # holding on to them.
                   @logger.debug('MiddleMan Handler: Sending keepalive message...')
-                  socket.write('NGS STILL THERE?')
+                  if monitor.session.exists?
+                    socket.write(['NGS STILL THERE?', "ACKED #{monitor.acked.to_i}"])
+                  else
+                    socket.write('NGS STILL THERE?')
+                  end
 
                   # Conceptually this spins until it receives a keepalive response or gives up,
                   # but I'm putting the condition here for shutdown purposes.
@@ -210,7 +338,7 @@ module Notgios
                   # block on the queue but still send keepalive messages, but its not, so I won't
                   # bother. As long as commands get sent within 10 seconds I'm sure people will be
                   # fine with it.
-                  send_command(socket, command_queue.pop) until command_queue.empty?
+                  send_commands(socket, command_queue, monitor, nodis)
                   message = socket.read((10 - (Time.now - keepalive_timer)).abs)
                   handle_monitor_message(message, monitor, nodis) unless message.empty?
                 end
@@ -228,10 +356,15 @@ module Notgios
           rescue SocketClosedError
             @logger.error('MiddleMan Handler: Encountered an error with the monitor socket, exiting...')
             socket.close
-            monitor.socket = nil
-            Helpers.with_nodis { |nodis| nodis.mark_disconnected(monitor.address) }
-            @logger.debug("MiddleMan Handler: Marked server #{monitor.address} as disconnected...")
-            @monitor_handlers.delete(monitor.address)
+
+            # A resuming monitor can beat us to noticing the old connection is dead, in which
+            # case a new handler already owns the monitor. Don't clobber it.
+            if monitor.socket.equal?(socket)
+              monitor.socket = nil
+              Helpers.with_nodis { |nodis| nodis.mark_disconnected(monitor.address) }
+              @logger.debug("MiddleMan Handler: Marked server #{monitor.address} as disconnected...")
+              @monitor_handlers.delete(monitor.address)
+            end
             @dead_handlers.push(handler)
           end
         end
@@ -259,8 +392,30 @@ module Notgios
                 # Parse out the passed port.
                 # TODO: Have to remember to enforce this > 1024 rule in the frontend.
                 port = message[1].scan(/\d+/).first.to_i
+                session = message.map { |line| line.scan(/\ASESSION (\S+)/).first }.compact.first
                 begin
-                  if port > 1024
+                  if session.exists?
+                    # Monitor understands sessions, so keep the connection it opened instead of
+                    # dialing back. If it's coming back to a session we still know about, tell it
+                    # which report we saw last so it only resends what we missed.
+                    unless message.first == 'NGS HELLO AGAIN' && session.first == monitor.session
+                      monitor.session = SecureRandom.hex(16)
+                      monitor.acked = 0
+                      monitor.seen = Set.new
+                    end
+                    socket.write(['NGS ACK', "SESSION #{monitor.session}", "ACKED #{monitor.acked}"])
+                    @logger.debug("MiddleMan: Sent ACK to monitor for session #{monitor.session}...")
+                    monitor.socket.close if monitor.socket.exists?
+                    monitor.socket = socket
+
+                    # Send the tasks.
+                    monitor.tasks.each { |task| monitor.queue.push(task) } unless message.first == 'NGS HELLO AGAIN'
+                    @logger.debug("MiddleMan: Enqueued #{monitor.tasks.size} tasks to be sent to the monitor...")
+
+                    # Start communication thread.
+                    start_monitor_handler(monitor)
+                    @logger.debug('MiddleMan: Started Handler thread...')
+                  elsif port > 1024
                     # We're good to go, let the monitor know.
                     socket.write('NGS ACK')
                     socket.close
@@ -142,10 +142,12 @@ module Notgios
       type = hget("notgios.jobs.#{id}", 'type')
       metric = hget("notgios.jobs.#{id}", 'metric')
 
-      # Grab the timestamp for the report.
-      timestamp = report.shift.scan(/TIMESTAMP (\d+)/)
+      # Grab the timestamp for the report. Monitors send it down to the nanosecond, which
+      # gets kept alongside the seconds so anything that only wants seconds still works.
+      timestamp = report.shift.scan(/TIMESTAMP (\d+)(?:\.(\d{1,9}))?/)
       raise InvalidJobError, 'Timestamp field of job report was malformed' unless timestamp.exists? && timestamp.first.exists?
-      timestamp = timestamp.first.first
+      timestamp, nsec = timestamp.first
+      nsec = nsec.to_s.ljust(9, '0').to_i
 
       case type.downcase
       when 'process', 'total'
@@ -154,7 +156,7 @@ module Notgios
           # Grab the CPU usage and add it to the zset.
           percent = report.shift.scan(/CPU PERCENT (\d+\.\d+)/)
           if percent.exists? && percent.first.exists?
-            lpush("notgios.reports.#{id}", { cpu: percent.first.first, timestamp: timestamp.to_i }.to_json)
+            lpush("notgios.reports.#{id}", with_tags({ cpu: percent.first.first, timestamp: timestamp.to_i, nsec: nsec }, report).to_json)
           else
             raise InvalidJobError, 'CPU field of job report was malformed'
           end
@@ -162,7 +164,7 @@ module Notgios
           # Grab the memory usage and add it to the zset.
           memory = report.shift.scan(/BYTES (\d+)/)
           if memory.exists? && memory.first.exists?
-            lpush("notgios.reports.#{id}", { bytes: memory.first.first, timestamp: timestamp.to_i }.to_json)
+            lpush("notgios.reports.#{id}", with_tags({ bytes: memory.first.first, timestamp: timestamp.to_i, nsec: nsec }, report).to_json)
           else
             raise InvalidJobError, 'BYTES field of job report was malformed'
           end
@@ -177,13 +179,29 @@ module Notgios
           # Grab the memory usage and add it to the zset.
           memory = report.shift.scan(/BYTES (\d+)/)
           if memory.exists? && memory.first.exists?
-            lpush("notgios.reports.#{id}", { bytes: memory.first.first, timestamp: timestamp.to_i }.to_json)
+            lpush("notgios.reports.#{id}", with_tags({ bytes: memory.first.first, timestamp: timestamp.to_i, nsec: nsec }, report).to_json)
           else
             raise InvalidJobError, 'BYTES field of job report was malformed'
           end
         else
           raise InvalidJobError, "Unknown job metric #{metric} for directory type"
         end
+      when 'self'
+        # Monitors report every number about themselves, whatever the metric, a line each.
+        numbers = {
+          cpu: /CPU PERCENT (\d+\.\d+)/,
+          bytes: /BYTES (\d+)/,
+          threads: /THREADS (\d+)/,
+          fds: /FDS (\d+)/,
+          switches: /SWITCHES (\d+)/
+        }
+        entry = {}
+        numbers.each_pair do |name, pattern|
+          value = report.map { |line| line.scan(pattern).first }.compact.first
+          raise InvalidJobError, "#{name.to_s.upcase} field of job report was malformed" unless value.exists?
+          entry[name] = value.first
+        end
+        lpush("notgios.reports.#{id}", with_tags(entry.merge(timestamp: timestamp.to_i, nsec: nsec), report).to_json)
       when 'disk'
         raise UnsupportedJobError, 'Job type disk isn\'t currently supported'
       when 'swap'
@@ -207,6 +225,7 @@ module Notgios
         srem("notgios.users.#{username}.jobs", id)
         del("notgios.jobs.#{id}")
         del("notgios.reports.#{id}")
+        del("notgios.alarms.#{id}")
       end
     end
 
@@ -331,9 +350,51 @@ module Notgios
 
     # Helpers
 
+    # Expects:
+    # id - Fixnum
+    # alarm - Array of the alarm's lines, after its ID
+    def post_job_alarm(id, alarm)
+      raise NoSuchResourceError, "Job #{id} does not exist" unless exists("notgios.jobs.#{id}")
+      fields = {}
+      alarm.each do |line|
+        key, value = line.split(' ', 2)
+        fields[key] = value
+      end
+      timestamp = fields['TIMESTAMP'].to_s.scan(/\A(\d+)(?:\.(\d{1,9}))?\z/).first
+      raise InvalidJobError, 'Timestamp field of job alarm was malformed' unless timestamp.exists?
+      raise InvalidJobError, 'State field of job alarm was malformed' unless %w(BREACHED CLEARED).include?(fields['STATE'])
+      entry = {
+        state: fields['STATE'].downcase,
+        value: fields['VALUE'].to_f,
+        threshold: fields['THRESHOLD'].to_f,
+        priority: fields['PRIORITY'].to_i,
+        timestamp: timestamp.first.to_i,
+        nsec: timestamp.last.to_s.ljust(9, '0').to_i
+      }
+      lpush("notgios.alarms.#{id}", entry.to_json)
+    end
+
     def next_id
       incr('notgios.id')
     end
 
+    # Monitors tack a DROPPED line onto the first report they manage to send after having
+    # to throw some away, so record it alongside the metric to explain the gap. Adaptive
+    # tasks also say how far apart they're collecting, in seconds, with an INTERVAL line, and
+    # windowed tasks summarize every sample from their last window with a WINDOW line.
+    def with_tags(entry, report)
+      dropped = report.map { |line| line.scan(/DROPPED (\d+)/).first }.compact.first
+      entry[:dropped] = dropped.first.to_i if dropped.exists?
+      interval = report.map { |line| line.scan(/INTERVAL (\d+(?:\.\d+)?)/).first }.compact.first
+      entry[:interval] = interval.first.to_f if interval.exists?
+      window = report.map { |line| line.scan(/WINDOW (\d+(?:\.\d+)?) COUNT (\d+)((?: [A-Z0-9]+ \d+(?:\.\d+)?)+)/).first }.compact.first
+      if window.exists?
+        seconds, count, stats = window
+        entry[:window] = { seconds: seconds.to_f, count: count.to_i }
+        stats.scan(/([A-Z0-9]+) (\d+(?:\.\d+)?)/).each { |name, value| entry[:window][name.downcase.to_sym] = value.to_f }
+      end
+      entry
+    end
+
   end
 end